@@ -0,0 +1,273 @@
+/*
+ * bb_engine.cpp - mips functional simulation by translated basic blocks
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#include <cstring>
+
+#include <algorithm>
+
+#include <bb_engine.h>
+#include <jit.h>
+
+/*
+ * Operation handlers. They reproduce FuncInstr::execute_* exactly,
+ * source and destination registers are the ones chosen by FuncInstr.
+ */
+static void op_add( BBState& s, const BBOp& op)   { s.reg[ op.dst] = (int32)s.reg[ op.src1] + (int32)s.reg[ op.src2]; }
+static void op_addu( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.reg[ op.src1] + s.reg[ op.src2]; }
+static void op_sub( BBState& s, const BBOp& op)   { s.reg[ op.dst] = (int32)s.reg[ op.src1] - (int32)s.reg[ op.src2]; }
+static void op_subu( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.reg[ op.src1] - s.reg[ op.src2]; }
+static void op_addi( BBState& s, const BBOp& op)  { s.reg[ op.dst] = (int32)s.reg[ op.src1] + (int16)op.imm; }
+static void op_addiu( BBState& s, const BBOp& op) { s.reg[ op.dst] = s.reg[ op.src1] + op.imm; }
+
+static void op_mult( BBState& s, const BBOp& op)
+{
+    uint64 mult_res = s.reg[ op.src1] * s.reg[ op.src2];
+    s.lo = mult_res & 0xFFFFFFFF;
+    s.hi = mult_res >> 0x20;
+}
+static void op_div( BBState& s, const BBOp& op)
+{
+    s.lo = s.reg[ op.src2] / s.reg[ op.src1];
+    s.hi = s.reg[ op.src2] % s.reg[ op.src1];
+}
+static void op_mfhi( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.hi; }
+static void op_mthi( BBState& s, const BBOp& op)  { s.hi = s.reg[ op.src2]; }
+static void op_mflo( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.lo; }
+static void op_mtlo( BBState& s, const BBOp& op)  { s.lo = s.reg[ op.src2]; }
+
+static void op_sll( BBState& s, const BBOp& op)   { s.reg[ op.dst] = s.reg[ op.src1] << op.imm; }
+static void op_srl( BBState& s, const BBOp& op)   { s.reg[ op.dst] = s.reg[ op.src1] >> op.imm; }
+static void op_sllv( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.reg[ op.src1] << s.reg[ op.src2]; }
+static void op_srlv( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.reg[ op.src1] >> s.reg[ op.src2]; }
+static void op_lui( BBState& s, const BBOp& op)   { s.reg[ op.dst] = op.imm << 0x10; }
+static void op_slt( BBState& s, const BBOp& op)   { s.reg[ op.dst] = s.reg[ op.src2] < s.reg[ op.src1]; }
+static void op_slti( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.reg[ op.src2] < op.imm; }
+
+static void op_and( BBState& s, const BBOp& op)   { s.reg[ op.dst] = s.reg[ op.src1] & s.reg[ op.src2]; }
+static void op_or( BBState& s, const BBOp& op)    { s.reg[ op.dst] = s.reg[ op.src1] | s.reg[ op.src2]; }
+static void op_xor( BBState& s, const BBOp& op)   { s.reg[ op.dst] = s.reg[ op.src1] ^ s.reg[ op.src2]; }
+static void op_nor( BBState& s, const BBOp& op)   { s.reg[ op.dst] = ~( s.reg[ op.src1] | s.reg[ op.src2]); }
+static void op_andi( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.reg[ op.src1] & op.imm; }
+static void op_ori( BBState& s, const BBOp& op)   { s.reg[ op.dst] = s.reg[ op.src1] | op.imm; }
+static void op_xori( BBState& s, const BBOp& op)  { s.reg[ op.dst] = s.reg[ op.src1] ^ op.imm; }
+
+// branch and jump targets are computed at translation time
+static void op_beq( BBState& s, const BBOp& op)   { if ( s.reg[ op.src1] == s.reg[ op.src2]) s.next_PC = op.imm; }
+static void op_bne( BBState& s, const BBOp& op)   { if ( s.reg[ op.src1] != s.reg[ op.src2]) s.next_PC = op.imm; }
+static void op_blez( BBState& s, const BBOp& op)  { if ( s.reg[ op.src1] <= 0) s.next_PC = op.imm; }
+static void op_bgtz( BBState& s, const BBOp& op)  { if ( s.reg[ op.src1] <= s.reg[ op.src2]) s.next_PC = op.imm; }
+static void op_j( BBState& s, const BBOp& op)     { s.next_PC = op.imm; }
+static void op_jal( BBState& s, const BBOp& op)   { s.reg[ op.dst] = op.instr->get_new_PC(); s.next_PC = op.imm; }
+static void op_jr( BBState& s, const BBOp& op)    { s.next_PC = s.reg[ op.src1]; }
+static void op_jalr( BBState& s, const BBOp& op)  { s.reg[ op.dst] = op.instr->get_new_PC(); s.next_PC = s.reg[ op.src2]; }
+static void op_nop( BBState&, const BBOp&)        { }
+
+static void op_load( BBState& s, const BBOp& op)
+{
+    s.mem_addr = s.reg[ op.src1] + op.imm;
+    s.reg[ op.dst] = s.mem->read( s.mem_addr, op.mem_size);
+}
+static void op_store( BBState& s, const BBOp& op)
+{
+    s.mem_addr = s.reg[ op.src1] + op.imm;
+    s.mem->write( s.reg[ op.src2], s.mem_addr, op.mem_size);
+    JIT::sync_tlb( s); // the write may have copied a page the TLB points to
+    if ( s.icache->invalidate( s.mem_addr, op.mem_size))
+        s.code_modified = true;
+}
+
+// handlers in the order of OpKind
+static const BBHandler handlers[] =
+{
+    op_add, op_addu, op_sub, op_subu, op_addi, op_addiu,
+    op_mult, op_div, op_mfhi, op_mthi, op_mflo, op_mtlo,
+    op_sll, op_srl, op_sllv, op_srlv, op_lui, op_slt, op_slti,
+    op_and, op_or, op_xor, op_nor, op_andi, op_ori, op_xori,
+    op_beq, op_bne, op_blez, op_bgtz, op_j, op_jal, op_jr, op_jalr,
+    op_nop, op_load, op_store
+};
+static_assert( sizeof( handlers) / sizeof( handlers[0]) == OP_KINDS_NUM,
+               "every operation must have a handler");
+
+BBEngine::BBEngine( RF* rf, FuncMemory* mem, InstrCache* icache,
+                    Trace* trace, CommitTraceWriter* commit_trace, bool use_jit) :
+    mem( mem),
+    icache( icache),
+    rf( rf),
+    jit( use_jit ? new JIT( trace == NULL && commit_trace == NULL) : NULL)
+{
+    memset( &state, 0, sizeof( state));
+    state.mem = mem;
+    state.icache = icache;
+    state.trace = trace;
+    state.commit_trace = commit_trace;
+}
+
+BBEngine::~BBEngine()
+{
+    flush();
+    delete jit;
+}
+
+void BBEngine::flush()
+{
+    for ( BlockMap::iterator it = blocks.begin(); it != blocks.end(); ++it)
+        delete it->second;
+    blocks.clear();
+    if ( jit != NULL)
+        jit->reset();
+    state.code_modified = false;
+}
+
+BBOp BBEngine::translate_instr( const FuncInstr& instr) const
+{
+    BBOp op;
+    op.kind = instr.get_op_kind();
+    op.handler = handlers[ op.kind];
+    op.src1 = instr.get_src1_num();
+    op.src2 = instr.get_src2_num();
+    op.dst  = ( instr.get_dst_num() == REG_NUM_ZERO) ? REG_NUM_MAX : instr.get_dst_num();
+    op.mem_size = instr.get_mem_size();
+    op.imm = instr.get_target_imm();
+    op.instr = &instr;
+    return op;
+}
+
+BBBlock* BBEngine::translate( uint32 PC)
+{
+    BBBlock* block = new BBBlock;
+    block->PC = PC;
+    block->next[ 0] = block->next[ 1] = NULL;
+    block->exec_count = 0;
+    block->code = NULL;
+
+    uint32 addr = PC;
+    while ( block->ops.size() < MAX_BLOCK_SIZE)
+    {
+        const FuncInstr* instr = icache->decode( *mem, addr);
+        if ( instr == NULL)
+            break;
+
+        BBOp op = translate_instr( *instr);
+        block->ops.push_back( op);
+        addr += sizeof( uint32);
+        if ( instr->isJump())
+            break;
+    }
+
+    if ( block->ops.empty())
+    {
+        delete block;
+        return NULL;
+    }
+
+    block->end_PC = addr;
+    blocks[ PC] = block;
+
+    // the code could be decoded in pages which were writable by TLB
+    if ( jit != NULL)
+        JIT::flush_tlb( state);
+    return block;
+}
+
+BBBlock* BBEngine::find_block( uint32 PC)
+{
+    BlockMap::iterator it = blocks.find( PC);
+    return ( it != blocks.end()) ? it->second : translate( PC);
+}
+
+BBBlock* BBEngine::next_block( BBBlock* block, uint32 PC)
+{
+    for ( size_t i = 0; i < 2; ++i)
+        if ( block->next[ i] != NULL && block->next[ i]->PC == PC)
+            return block->next[ i];
+
+    BBBlock* next = find_block( PC);
+    if ( next != NULL)
+        block->next[ block->next[ 0] == NULL ? 0 : 1] = next;
+    return next;
+}
+
+void BBEngine::dump( const BBState& state, const BBOp& op)
+{
+    if ( state.trace != NULL)
+    {
+        FuncInstr instr = *op.instr;
+        instr.set_result( state.reg[ op.dst]);
+        *state.trace << instr << '\n';
+    }
+    if ( state.commit_trace != NULL)
+    {
+        const FuncInstr& instr = *op.instr;
+        CommitRecord record = { instr.get_PC(), instr.get_bytes(),
+                                uint8( instr.get_dst_num()), state.reg[ op.dst],
+                                instr.is_load() || instr.is_store(), state.mem_addr };
+        state.commit_trace->write( record);
+    }
+}
+
+uint32 BBEngine::run( uint32& PC, uint32 instrs_to_run)
+{
+    for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+        state.reg[ i] = rf->read( (RegNum)i);
+    if ( jit != NULL)
+        JIT::flush_tlb( state);
+
+    uint32 executed = 0;
+    BBBlock* block = NULL;
+    bool need_flush = false;
+    while ( executed < instrs_to_run)
+    {
+        block = ( block == NULL) ? find_block( PC) : next_block( block, PC);
+        if ( block == NULL)
+            break;
+
+        size_t size = std::min<size_t>( block->ops.size(), instrs_to_run - executed);
+        state.next_PC = block->end_PC;
+
+        bool is_full_block = ( size == block->ops.size());
+        if ( jit != NULL && is_full_block && ++block->exec_count == JIT_THRESHOLD)
+        {
+            // blocks with unsupported operations stay interpreted
+            block->code = jit->compile( *block);
+            if ( block->code == NULL && jit->is_full())
+                need_flush = true;
+        }
+
+        size_t i = 0;
+        if ( block->code != NULL && is_full_block)
+        {
+            i = block->code( &state);
+        }
+        else
+        {
+            while ( i < size)
+            {
+                const BBOp& op = block->ops[ i++];
+                op.handler( state, op);
+                if ( state.trace != NULL || state.commit_trace != NULL)
+                    dump( state, op);
+                if ( state.code_modified)
+                    break;
+            }
+        }
+
+        executed += i;
+        PC = ( i == block->ops.size()) ? state.next_PC
+                                       : block->PC + i * sizeof( uint32);
+
+        // the code buffer is refilled from scratch when it runs out
+        if ( state.code_modified || need_flush)
+        {
+            flush();
+            block = NULL;
+            need_flush = false;
+        }
+    }
+
+    for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+        rf->write( (RegNum)i, state.reg[ i]);
+    return executed;
+}
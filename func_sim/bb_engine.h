@@ -0,0 +1,127 @@
+/*
+ * bb_engine.h - mips functional simulation by translated basic blocks
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef BB_ENGINE_H
+#define BB_ENGINE_H
+
+#include <map>
+#include <vector>
+
+#include <func_instr.h>
+#include <func_memory.h>
+#include <instr_cache.h>
+#include <rf.h>
+#include <trace.h>
+#include <commit_trace.h>
+
+/* Entry of software TLB used by compiled code, see JIT. */
+struct BBTLBEntry
+{
+    uint32 page_num; // tag, ~0 if the entry is empty
+    uint8* host_page;
+};
+
+/* Architectural state visible to operation handlers. */
+struct BBState
+{
+    // the extra register is a sink for writes to $zero
+    uint32 reg[ REG_NUM_MAX + 1];
+    uint32 hi;
+    uint32 lo;
+
+    uint32 next_PC; // PC after the block, changed by taken jumps
+
+    FuncMemory* mem;
+    InstrCache* icache;
+    Trace* trace; // NULL if no trace is printed
+    CommitTraceWriter* commit_trace; // NULL if no commit trace is written
+    uint32 mem_addr; // address of the last load or store, for the commit trace
+    bool code_modified; // a store has overwritten translated code
+
+    // pages containing decoded code are never put to write TLB
+    static const uint32 TLB_SIZE = 64;
+    uint32 mem_generation; // of the memory when TLB was filled
+
+    BBTLBEntry read_tlb[ TLB_SIZE];
+    BBTLBEntry write_tlb[ TLB_SIZE];
+};
+
+struct BBOp;
+typedef void (*BBHandler)( BBState& state, const BBOp& op);
+
+/* Pre-resolved operation: everything is known at translation time. */
+struct BBOp
+{
+    BBHandler handler;
+    OpKind kind;
+    uint8 src1;
+    uint8 src2;
+    uint8 dst;
+    uint8 mem_size;
+    uint32 imm; // immediate or target address of a jump
+    const FuncInstr* instr; // decoded instruction, used for the trace
+};
+
+/*
+ * Host code of a block, returns number of executed operations.
+ * It is less than the block size if a store has modified the code.
+ */
+typedef uint32 (*BBCode)( BBState* state);
+
+/* Straight-line code ending with a jump (or limited by size). */
+struct BBBlock
+{
+    uint32 PC;
+    uint32 end_PC; // PC following the last instruction
+    std::vector<BBOp> ops;
+    BBBlock* next[ 2]; // chained successors
+
+    uint32 exec_count; // hot blocks are compiled to host code
+    BBCode code;
+};
+
+class JIT;
+
+class BBEngine
+{
+        static const size_t MAX_BLOCK_SIZE = 64;
+        static const uint32 JIT_THRESHOLD = 16;
+
+        FuncMemory* mem;
+        InstrCache* icache;
+        RF* rf;
+        JIT* jit; // NULL if blocks are not compiled
+
+        BBState state;
+
+        typedef std::map<uint32, BBBlock*> BlockMap;
+        BlockMap blocks;
+
+        BBOp translate_instr( const FuncInstr& instr) const;
+        BBBlock* translate( uint32 PC);
+        BBBlock* find_block( uint32 PC);
+        BBBlock* next_block( BBBlock* block, uint32 PC);
+
+    public:
+        BBEngine( RF* rf, FuncMemory* mem, InstrCache* icache,
+                  Trace* trace, CommitTraceWriter* commit_trace, bool use_jit);
+        ~BBEngine();
+
+        /*
+         * Executes up to instrs_to_run instructions starting from PC,
+         * PC is updated. Returns number of executed instructions, it is
+         * less than requested if the code at PC cannot be translated and
+         * one instruction should be executed by the interpreter.
+         */
+        uint32 run( uint32& PC, uint32 instrs_to_run);
+
+        /* Drops all translated blocks, e.g. if the code was overwritten. */
+        void flush();
+
+        /* Prints the executed operation to the trace and the commit trace. */
+        static void dump( const BBState& state, const BBOp& op);
+};
+
+#endif
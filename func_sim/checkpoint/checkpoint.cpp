@@ -0,0 +1,110 @@
+/*
+ * checkpoint.cpp - architectural state of mips program saved to a file
+ * Copyright 2015 MIPT-MIPS
+ */
+
+// Generic C
+#include <cstdlib>
+#include <cstring>
+
+// Generic C++
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// MIPT-MIPS modules
+#include <checkpoint.h>
+#include <page_image.h>
+
+static const char MAGIC[] = { 'M', 'C', 'K', '1' };
+
+struct Header
+{
+    char magic[ sizeof( MAGIC)];
+    uint32 PC;
+    uint32 reg[ Checkpoint::REG_NUM];
+    uint64 instrs_executed;
+    PageImage::Layout pages;
+};
+
+bool Checkpoint::is_checkpoint( const std::string& file_name)
+{
+    char magic[ sizeof( MAGIC)];
+    std::ifstream file( file_name.c_str(), std::ios::binary);
+    return file.read( magic, sizeof( magic)) && !memcmp( magic, MAGIC, sizeof( MAGIC));
+}
+
+std::string Checkpoint::elf_file_name( const std::string& file_name)
+{
+    static const std::string suffix = ".ckpt";
+    if ( file_name.size() <= suffix.size() ||
+         file_name.compare( file_name.size() - suffix.size(), suffix.size(), suffix) != 0)
+    {
+        return file_name;
+    }
+
+    std::string name = file_name.substr( 0, file_name.size() - suffix.size());
+    size_t dot = name.find_last_of( '.');
+    if ( dot == std::string::npos || dot + 1 == name.size() ||
+         name.find_first_not_of( "0123456789", dot + 1) != std::string::npos)
+    {
+        return file_name;
+    }
+    return name.substr( 0, dot);
+}
+
+void Checkpoint::save( const std::string& file_name,
+                       const FuncMemory& mem, const State& state)
+{
+    Header header;
+    memset( &header, 0, sizeof( header));
+    memcpy( header.magic, MAGIC, sizeof( MAGIC));
+    header.PC = state.PC;
+    memcpy( header.reg, state.reg, sizeof( header.reg));
+    header.instrs_executed = state.instrs_executed;
+    std::vector<uint64> pages;
+    PageImage::init( header.pages, mem, sizeof( header), pages);
+
+    std::ofstream file( file_name.c_str(), std::ios::binary | std::ios::trunc);
+    if ( !file)
+    {
+        std::cerr << "ERROR: Could not create checkpoint " << file_name << std::endl;
+        exit( EXIT_FAILURE);
+    }
+
+    file.write( reinterpret_cast<const char*>( &header), sizeof( header));
+    PageImage::write( file, header.pages, sizeof( header), mem, pages);
+
+    if ( !file.flush())
+    {
+        std::cerr << "ERROR: Could not write checkpoint " << file_name << std::endl;
+        exit( EXIT_FAILURE);
+    }
+}
+
+FuncMemory* Checkpoint::load( const std::string& file_name, State& state,
+                              FuncMemory::Backend backend)
+{
+    size_t size = 0;
+    uint8* data = PageImage::map_file( file_name, sizeof( Header), size);
+    if ( data == NULL)
+    {
+        std::cerr << "ERROR: Could not load checkpoint " << file_name << std::endl;
+        exit( EXIT_FAILURE);
+    }
+
+    const Header& header = *reinterpret_cast<const Header*>( data);
+    if ( memcmp( header.magic, MAGIC, sizeof( MAGIC)) ||
+         !PageImage::check( header.pages, sizeof( Header), size))
+    {
+        std::cerr << "ERROR: " << file_name << " is not a checkpoint" << std::endl;
+        exit( EXIT_FAILURE);
+    }
+
+    state.PC = header.PC;
+    memcpy( state.reg, header.reg, sizeof( state.reg));
+    state.instrs_executed = header.instrs_executed;
+
+    return PageImage::map_pages( data, size, header.pages, sizeof( Header),
+                                 header.PC, backend);
+}
@@ -0,0 +1,54 @@
+/*
+ * checkpoint.h - architectural state of mips program saved to a file
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// Generic C++
+#include <string>
+
+// MIPT-MIPS modules
+#include <types.h>
+#include <func_memory.h>
+
+/*
+ * Checkpoint contains registers, PC and all allocated memory pages.
+ * File layout: header, then pages as PageImage keeps them.
+ */
+class Checkpoint
+{
+    public:
+        static const size_t REG_NUM = 32;
+
+        /* Architectural state besides the memory. */
+        struct State
+        {
+            uint32 PC;
+            uint32 reg[ REG_NUM];
+            uint64 instrs_executed; // before the checkpoint
+        };
+
+        /* Checks if the file starts as a checkpoint, e.g. to tell it from ELF. */
+        static bool is_checkpoint( const std::string& file_name);
+
+        /*
+         * Returns mips_exe of checkpoint "<mips_exe>.<count>.ckpt" saved by
+         * func_sim, e.g. to read its symbols. Other names are returned as is.
+         */
+        static std::string elf_file_name( const std::string& file_name);
+
+        static void save( const std::string& file_name,
+                          const FuncMemory& mem, const State& state);
+
+        /*
+         * Restores the state and creates memory with pages mapped from
+         * the file: they are read on the first access only, stores
+         * do not change the file. Flat memory backend copies the pages.
+         */
+        static FuncMemory* load( const std::string& file_name, State& state,
+                                 FuncMemory::Backend backend = FuncMemory::BACKEND_TABLES);
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,102 @@
+// generic C
+#include <cstdlib>
+#include <unistd.h>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// MIPT-MIPS modules
+#include <checkpoint.h>
+
+static const char * valid_elf_file = "../func_memory/mips_bin_exmpl.out";
+static const char * checkpoint_file = "./checkpoint_test.ckpt";
+
+static Checkpoint::State make_state()
+{
+    Checkpoint::State state;
+    state.PC = 0x4000b0;
+    for ( size_t i = 0; i < Checkpoint::REG_NUM; ++i)
+        state.reg[ i] = i * 0x01010101;
+    state.instrs_executed = 1000;
+    return state;
+}
+
+TEST( Checkpoint, Save_Load)
+{
+    FuncMemory mem( valid_elf_file);
+    mem.write( 0xdeadbeef, 0x7ffffff0);
+    Checkpoint::State saved = make_state();
+    Checkpoint::save( checkpoint_file, mem, saved);
+    ASSERT_TRUE( Checkpoint::is_checkpoint( checkpoint_file));
+    ASSERT_FALSE( Checkpoint::is_checkpoint( valid_elf_file));
+
+    Checkpoint::State state;
+    FuncMemory* loaded = Checkpoint::load( checkpoint_file, state);
+    ASSERT_EQ( state.PC, saved.PC);
+    ASSERT_EQ( loaded->startPC(), saved.PC);
+    ASSERT_EQ( state.instrs_executed, saved.instrs_executed);
+    for ( size_t i = 0; i < Checkpoint::REG_NUM; ++i)
+        ASSERT_EQ( state.reg[ i], saved.reg[ i]);
+
+    std::vector<uint64> pages;
+    std::vector<uint64> loaded_pages;
+    mem.get_pages( pages);
+    loaded->get_pages( loaded_pages);
+    ASSERT_EQ( pages, loaded_pages);
+    for ( size_t i = 0; i < pages.size(); ++i)
+        for ( uint64 addr = pages[ i]; addr < pages[ i] + mem.get_page_size(); addr += 4)
+            ASSERT_EQ( loaded->read( addr), mem.read( addr));
+
+    // stores change the restored memory, but not the file
+    loaded->write( 0x12345678, 0x7ffffff0);
+    loaded->write( 0x1, 0x10000000); // a new page
+    ASSERT_EQ( loaded->read( 0x7ffffff0), 0x12345678ull);
+    delete loaded;
+
+    loaded = Checkpoint::load( checkpoint_file, state);
+    ASSERT_EQ( loaded->read( 0x7ffffff0), 0xdeadbeefull);
+    ASSERT_FALSE( loaded->check( 0x10000000));
+    delete loaded;
+    unlink( checkpoint_file);
+}
+
+TEST( Checkpoint, Empty_Memory)
+{
+    FuncMemory mem( 0x400000, 32, 10, 12);
+    Checkpoint::save( checkpoint_file, mem, make_state());
+
+    Checkpoint::State state;
+    FuncMemory* loaded = Checkpoint::load( checkpoint_file, state);
+    std::vector<uint64> pages;
+    loaded->get_pages( pages);
+    ASSERT_TRUE( pages.empty());
+    delete loaded;
+    unlink( checkpoint_file);
+}
+
+TEST( Checkpoint, Wrong_File)
+{
+    Checkpoint::State state;
+    ASSERT_EXIT( Checkpoint::load( "./1234567890/qwertyuiop", state),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+    ASSERT_EXIT( Checkpoint::load( valid_elf_file, state),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+    ASSERT_EXIT( Checkpoint::save( "./1234567890/qwertyuiop",
+                                   FuncMemory( 0x400000, 32, 10, 12), make_state()),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+}
+
+TEST( Checkpoint, Elf_File_Name)
+{
+    ASSERT_EQ( Checkpoint::elf_file_name( "dir/prog.out.1000.ckpt"), "dir/prog.out");
+    ASSERT_EQ( Checkpoint::elf_file_name( "prog.out"), "prog.out");
+    ASSERT_EQ( Checkpoint::elf_file_name( "prog.ckpt"), "prog.ckpt");
+    ASSERT_EQ( Checkpoint::elf_file_name( "prog.x1.ckpt"), "prog.x1.ckpt");
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
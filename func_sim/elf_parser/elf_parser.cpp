@@ -6,16 +6,18 @@
 
 // Genereic C
 #include <libelf.h>
-#include <cstdio>
 #include <unistd.h>
 #include <cstring>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <gelf.h>
 #include <cstdlib>
 #include <cerrno>
 #include <cassert>
 
 // Generic C++
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -25,57 +27,12 @@
 
 using namespace std;
 
-ElfSection::ElfSection()
+// opens the file by a descriptor, it is used for both libelf and pread
+static Elf* openElf( const char* elf_file_name, int* file_descr)
 {
-    cerr << "ERROR: the constructor without parameters "
-         << "of ElfSection class is prohobited" << endl;
-    exit( EXIT_FAILURE);
-}
-
-ElfSection::ElfSection( const ElfSection& that)
-    : size( that.size), start_addr( that.start_addr)
-{
-    this->name = new char[ strlen( that.name) + 1];
-    strcpy( this->name, that.name);
-    
-    this->content = new uint8[size];
-    memcpy(this->content, that.content, this->size);
-}
-
-ElfSection& ElfSection::operator=(const ElfSection& that)
-{
-    this->name = new char[ strlen( that.name) + 1];
-    strcpy( this->name, that.name);
-    
-    this->size = that.size;
-    this->start_addr = that.start_addr;
-
-    this->content = new uint8[ this->size + sizeof( uint64)];
-    memcpy( this->content, that.content, this->size);
-        
-    return *this;
-}
-
-ElfSection::ElfSection( const char* name, uint64 start_addr,
-                        uint64 size, const uint8* content)
-{
-    this->name = new char[ strlen( name) + 1];
-    strcpy( this->name, name);
-
-    this->size = size;
-    this->start_addr = start_addr;
-
-    this->content = new uint8[ this->size + sizeof( uint64)];
-    memcpy( this->content, content, size);
-}
-
-void ElfSection::getAllElfSections( const char* elf_file_name,
-                                    vector<ElfSection>& sections_array /*is used as output*/)
-{
-    // open the binary file, we have to use C-style open,
-    // because it is required by elf_begin function
-    int file_descr = open( elf_file_name, O_RDONLY); 
-    if ( file_descr < 0)
+    // we have to use C-style open, because it is required by elf_begin function
+    *file_descr = open( elf_file_name, O_RDONLY); 
+    if ( *file_descr < 0)
     {
         cerr << "ERROR: Could not open file " << elf_file_name << ": "
              << strerror( errno) << endl;
@@ -91,7 +48,7 @@ void ElfSection::getAllElfSections( const char* elf_file_name,
     }
    
     // open the file in ELF format 
-    Elf* elf = elf_begin( file_descr, ELF_C_READ, NULL);
+    Elf* elf = elf_begin( *file_descr, ELF_C_READ, NULL);
     if ( !elf)
     {
         cerr << "ERROR: Could not open file " << elf_file_name
@@ -99,6 +56,118 @@ void ElfSection::getAllElfSections( const char* elf_file_name,
              <<  elf_errmsg( elf_errno()) << endl;
         exit( EXIT_FAILURE);
     }
+    return elf;
+}
+
+ElfImage::ElfImage( int file_descr, const char* elf_file_name)
+    : data( NULL)
+    , size( 0)
+    , refs( 1)
+{
+    struct stat st;
+    if ( fstat( file_descr, &st) != 0)
+    {
+        cerr << "ERROR: Could not open file " << elf_file_name << ": "
+             << strerror( errno) << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    size = st.st_size;
+    if ( size == 0)
+        return;
+
+    void* ptr = mmap( NULL, size, PROT_READ, MAP_PRIVATE, file_descr, 0);
+    if ( ptr == MAP_FAILED)
+    {
+        cerr << "ERROR: Could not map file " << elf_file_name << ": "
+             << strerror( errno) << endl;
+        exit( EXIT_FAILURE);
+    }
+    data = static_cast<uint8*>( ptr);
+}
+
+ElfImage::~ElfImage()
+{
+    if ( data != NULL)
+        munmap( data, size);
+}
+
+void ElfImage::ref()
+{
+    __sync_add_and_fetch( &refs, 1);
+}
+
+void ElfImage::unref()
+{
+    if ( __sync_sub_and_fetch( &refs, 1) == 0)
+        delete this;
+}
+
+ElfSection::ElfSection( const char* name, uint64 start_addr, uint64 size,
+                        ElfImage* image, const uint8* content, uint64 file_size)
+    : image( image)
+    , name( name)
+    , size( size)
+    , start_addr( start_addr)
+    , content( content)
+    , file_size( file_size)
+{
+    if ( this->image != NULL)
+        this->image->ref();
+}
+
+ElfSection::ElfSection( ElfSection&& that) noexcept
+    : image( that.image)
+    , name( std::move( that.name))
+    , size( that.size)
+    , start_addr( that.start_addr)
+    , content( that.content)
+    , file_size( that.file_size)
+{
+    that.image = NULL;
+    that.content = NULL;
+    that.size = that.file_size = 0;
+}
+
+ElfSection& ElfSection::operator=( ElfSection&& that) noexcept
+{
+    if ( this != &that)
+    {
+        if ( this->image != NULL)
+            this->image->unref();
+
+        this->image = that.image;
+        this->name = std::move( that.name);
+        this->size = that.size;
+        this->start_addr = that.start_addr;
+        this->content = that.content;
+        this->file_size = that.file_size;
+
+        that.image = NULL;
+        that.content = NULL;
+        that.size = that.file_size = 0;
+    }
+    return *this;
+}
+
+// checks that the content lies in the mapped file
+static void checkContent( const ElfImage* image, const char* elf_file_name,
+                          uint64 offset, uint64 size)
+{
+    if ( offset > image->getSize() || size > image->getSize() - offset)
+    {
+        cerr << "ERROR: Content at offset 0x" << hex << offset << dec
+             << " is out of file " << elf_file_name << endl;
+        exit( EXIT_FAILURE);
+    }
+}
+
+void ElfSection::getAllElfSections( const char* elf_file_name,
+                                    vector<ElfSection>& sections_array /*is used as output*/)
+{
+    int file_descr;
+    Elf* elf = openElf( elf_file_name, &file_descr);
+    ElfImage* image = new ElfImage( file_descr, elf_file_name);
     
     size_t shstrndx;
     elf_getshdrstrndx( elf, &shstrndx);
@@ -109,41 +178,89 @@ void ElfSection::getAllElfSections( const char* elf_file_name,
         GElf_Shdr shdr;
         gelf_getshdr( section, &shdr);
 
-        char* name = elf_strptr( elf, shstrndx, shdr.sh_name);
         uint64 start_addr = ( uint64)shdr.sh_addr;
-        
         if ( start_addr == 0)
             continue;
 
+        // ".bss" has no content in the file
         uint64 size = ( uint64)shdr.sh_size;
-        uint64 offset = ( uint64)shdr.sh_offset;
-	    uint8* content = new uint8[ size];
-        
-        lseek( file_descr, offset, SEEK_SET);
-        FILE *file = fdopen( file_descr, "r");
-        if ( !file )
+        uint64 file_size = 0;
+        const uint8* content = NULL;
+        if ( shdr.sh_type != SHT_NOBITS)
         {
-            cerr << "ERROR: Could not open file " << elf_file_name << ": "
-                 << strerror(errno) << endl;
-            exit( EXIT_FAILURE);
+            checkContent( image, elf_file_name, shdr.sh_offset, size);
+            file_size = size;
+            content = image->getData() + shdr.sh_offset;
         }
-        
-        // fill the content by the section data
-        fread( content, sizeof( uint8), size, file);
-        ElfSection section( name, start_addr, size, content);
-	    sections_array.push_back( ElfSection( name, start_addr, size, content));
-        delete [] content;
+
+        const char* name = elf_strptr( elf, shstrndx, shdr.sh_name);
+        sections_array.push_back( ElfSection( name, start_addr, size,
+                                              image, content, file_size));
     }
     
-    // close all used files
+    // close all used files, the image stays mapped while sections use it
+    image->unref();
+    elf_end( elf);
+    close( file_descr);
+}
+
+uint64 ElfSection::getLoadSegments( const char* elf_file_name,
+                                    vector<ElfSection>& segments /*is used as output*/)
+{
+    int file_descr;
+    Elf* elf = openElf( elf_file_name, &file_descr);
+    ElfImage* image = new ElfImage( file_descr, elf_file_name);
+
+    GElf_Ehdr ehdr;
+    size_t phdrnum;
+    if ( gelf_getehdr( elf, &ehdr) == NULL || elf_getphdrnum( elf, &phdrnum) != 0)
+    {
+        cerr << "ERROR: Could not read program headers of " << elf_file_name
+             << ": " << elf_errmsg( elf_errno()) << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    for ( size_t i = 0; i < phdrnum; ++i)
+    {
+        GElf_Phdr phdr;
+        gelf_getphdr( elf, i, &phdr);
+        if ( phdr.p_type != PT_LOAD || phdr.p_memsz == 0)
+            continue;
+
+        if ( phdr.p_filesz > phdr.p_memsz)
+        {
+            cerr << "ERROR: Segment at 0x" << hex << phdr.p_vaddr << dec
+                 << " of " << elf_file_name << " is larger in the file "
+                 << "than in memory" << endl;
+            exit( EXIT_FAILURE);
+        }
+
+        checkContent( image, elf_file_name, phdr.p_offset, phdr.p_filesz);
+        segments.push_back( ElfSection( "LOAD", phdr.p_vaddr, phdr.p_memsz, image,
+                                        image->getData() + phdr.p_offset,
+                                        phdr.p_filesz));
+    }
+
+    image->unref();
     elf_end( elf);
     close( file_descr);
+    return ehdr.e_entry;
 }
 
 ElfSection::~ElfSection()
 {
-    delete [] this->name;
-    delete [] this->content;
+    if ( this->image != NULL)
+        this->image->unref();
+}
+
+uint32 ElfSection::getWord( uint64 offset) const
+{
+    // the zero tail is not in the file
+    uint32 word = 0;
+    if ( offset < this->file_size)
+        memcpy( &word, this->content + offset,
+                min< uint64>( sizeof( word), this->file_size - offset));
+    return word;
 }
 
 string ElfSection::dump( string indent) const
@@ -196,8 +313,9 @@ string ElfSection::strByBytes() const
         oss.fill( '0'); // thus, number 8 will be printed as "08"
         
         // print a value of 
-        oss << (uint16) *( this->content + i); // need converting to uint16
-                                               // to be not preinted as an alphabet symbol	
+        uint8 byte = i < this->file_size ? this->content[ i] : 0;
+        oss << (uint16) byte; // need converting to uint16
+                              // to be not preinted as an alphabet symbol	
     }
     
     return oss.str();
@@ -215,9 +333,115 @@ string ElfSection::strByWords() const
         oss.width( 8); // because we need 8 hex symbols to print a word (e.g. "ffffffff")
         oss.fill( '0'); // thus, number a44f will be printed as "0000a44f"
         
-        oss << *( ( uint32*)this->content + i);
+        oss << this->getWord( i * sizeof( uint32));
     }
     
     return oss.str();
 }
 
+
+// symbol read from the table with its place among those of the same address
+struct SymbolEntry
+{
+    ElfSymbol symbol;
+    uint64 section_end;
+    int rank; // less is preferred
+    size_t index; // in the table
+};
+
+static bool operator<( const SymbolEntry& a, const SymbolEntry& b)
+{
+    if ( a.symbol.addr != b.symbol.addr)
+        return a.symbol.addr < b.symbol.addr;
+    if ( a.rank != b.rank)
+        return a.rank < b.rank;
+    return a.index < b.index;
+}
+
+static bool addrLess( uint64 addr, const ElfSymbol& symbol)
+{
+    return addr < symbol.addr;
+}
+
+ElfSymbolIndex::ElfSymbolIndex( const char* elf_file_name)
+{
+    int file_descr;
+    Elf* elf = openElf( elf_file_name, &file_descr);
+
+    vector<SymbolEntry> entries;
+    Elf_Scn *section = NULL;
+    while ( (section = elf_nextscn( elf, section)) != NULL)
+    {
+        GElf_Shdr shdr;
+        gelf_getshdr( section, &shdr);
+        if ( shdr.sh_type != SHT_SYMTAB || shdr.sh_entsize == 0)
+            continue;
+
+        Elf_Data* data = elf_getdata( section, NULL);
+        size_t num = data != NULL ? shdr.sh_size / shdr.sh_entsize : 0;
+        for ( size_t i = 0; i < num; ++i)
+        {
+            GElf_Sym sym;
+            gelf_getsym( data, i, &sym);
+            int type = GELF_ST_TYPE( sym.st_info);
+            if ( type == STT_SECTION || type == STT_FILE ||
+                 sym.st_shndx == SHN_UNDEF || sym.st_shndx >= SHN_LORESERVE)
+                continue;
+
+            // only symbols of code are kept
+            GElf_Shdr code_shdr;
+            Elf_Scn* code = elf_getscn( elf, sym.st_shndx);
+            if ( code == NULL || gelf_getshdr( code, &code_shdr) == NULL ||
+                 ( code_shdr.sh_flags & SHF_EXECINSTR) == 0)
+                continue;
+
+            SymbolEntry entry;
+            entry.symbol.name = elf_strptr( elf, shdr.sh_link, sym.st_name);
+            entry.symbol.addr = sym.st_value;
+            entry.symbol.size = sym.st_size;
+            entry.section_end = code_shdr.sh_addr + code_shdr.sh_size;
+            entry.rank = ( type == STT_FUNC ? 0 : 2) +
+                         ( GELF_ST_BIND( sym.st_info) == STB_LOCAL ? 1 : 0);
+            entry.index = i;
+            entries.push_back( entry);
+        }
+    }
+
+    elf_end( elf);
+    close( file_descr);
+
+    sort( entries.begin(), entries.end());
+    for ( size_t i = 0; i < entries.size(); ++i)
+    {
+        if ( i != 0 && entries[ i].symbol.addr == entries[ i - 1].symbol.addr)
+            continue;
+
+        // the next symbol or the end of section limits the symbol
+        uint64 limit = entries[ i].section_end;
+        for ( size_t j = i + 1; j < entries.size(); ++j)
+        {
+            if ( entries[ j].symbol.addr != entries[ i].symbol.addr)
+            {
+                limit = min( limit, entries[ j].symbol.addr);
+                break;
+            }
+        }
+
+        ElfSymbol& symbol = entries[ i].symbol;
+        if ( symbol.addr >= limit)
+            continue;
+        if ( symbol.size == 0 || symbol.size > limit - symbol.addr)
+            symbol.size = limit - symbol.addr;
+        symbols.push_back( symbol);
+    }
+}
+
+size_t ElfSymbolIndex::find( uint64 addr) const
+{
+    vector<ElfSymbol>::const_iterator it = upper_bound( symbols.begin(), symbols.end(),
+                                                        addr, addrLess);
+    if ( it == symbols.begin())
+        return symbols.size();
+    --it;
+    return addr - it->addr < it->size ? it - symbols.begin() : symbols.size();
+}
@@ -18,27 +18,73 @@ class Elf;
 
 using namespace std;
 
+/*
+ * Read-only mapping of an ELF file. Sections point to their content in
+ * it, so they share the file instead of copying it. The mapping is
+ * reference counted and unmapped with the last reference.
+ */
+class ElfImage
+{
+    uint8* data;
+    uint64 size;
+    uint32 refs;
+
+    ~ElfImage(); // use unref()
+
+    ElfImage( const ElfImage& that) = delete;
+    ElfImage& operator=( const ElfImage& that) = delete;
+
+public:
+    // maps the opened file, the image is referenced once
+    ElfImage( int file_descr, const char* elf_file_name);
+
+    void ref();
+    void unref();
+
+    const uint8* getData() const { return data; }
+    uint64 getSize() const { return size; }
+};
+
 class ElfSection
 {
+    ElfImage* image; // keeps content mapped, NULL if there is no content
+
     // You cannot use this constructor to create an object.
-    // Use the static function getAllElfSections.
-    ElfSection(); 
-    ElfSection( const char* name, uint64 start_addr,
-                uint64 size, const uint8* content);
+    // Use the static functions getAllElfSections and getLoadSegments.
+    ElfSection( const char* name, uint64 start_addr, uint64 size,
+                ElfImage* image, const uint8* content, uint64 file_size);
+
+    // sections are moved rather than copied, a copy would only share
+    // the content with the original
+    ElfSection( const ElfSection& that) = delete;
+    ElfSection& operator=( const ElfSection& that) = delete;
+
+    uint32 getWord( uint64 offset) const;
 
 public:
-    char* name; // name of the elf section (e.g. ".text", ".data", etc)
+    string name; // name of the elf section (e.g. ".text", ".data", etc)
     uint64 size; // size of the section in bytes
     uint64 start_addr; // the start address of the section
-    uint8* content; // the row data of the section
+    const uint8* content; // the row data of the section in the mapped file
+    uint64 file_size; // bytes of content, the rest up to size is zero (".bss")
 
-    ElfSection( const  ElfSection& old);
-    ElfSection& operator=( const ElfSection& that);
+    ElfSection( ElfSection&& that) noexcept;
+    ElfSection& operator=( ElfSection&& that) noexcept;
     
     // Use this function to extract all sections from the ELF binary file.
     // Note that the 2nd parameter is used as output.
     static void getAllElfSections( const char* elf_file_name,
                                    vector<ElfSection>& sections_array /*used as output*/);
+
+    // Use this function to get the memory image described by program
+    // headers: one section named "LOAD" per PT_LOAD segment, its tail
+    // beyond the file size is zero. Returns the entry point.
+    static uint64 getLoadSegments( const char* elf_file_name,
+                                   vector<ElfSection>& segments /*used as output*/);
+
+    // The mapped file holding the content, it may be referenced to keep
+    // the content after the section is destroyed.
+    ElfImage* getImage() const { return image; }
     
     virtual ~ElfSection();
     
@@ -47,4 +93,32 @@ public:
     string strByWords() const;
 };
 
+/* Symbol of code, e.g. a function or a label of hand-written code. */
+struct ElfSymbol
+{
+    string name;
+    uint64 addr;
+    uint64 size; // a symbol of zero size in the file lasts till the next one
+};
+
+/*
+ * Code symbols of ".symtab" sorted by address, so the symbol holding an
+ * address is found by binary search. Symbols do not overlap: a symbol
+ * is cut at the next one, only one of symbols with the same address is
+ * kept, a function is preferred to a label and global to local one.
+ */
+class ElfSymbolIndex
+{
+    vector<ElfSymbol> symbols;
+
+public:
+    explicit ElfSymbolIndex( const char* elf_file_name);
+
+    // returns index of the symbol holding addr or size() if there is none
+    size_t find( uint64 addr) const;
+
+    size_t size() const { return symbols.size(); }
+    const ElfSymbol& operator[]( size_t index) const { return symbols[ index]; }
+};
+
 #endif // #ifndef ELF_PARSER__ELF_PARSER_H
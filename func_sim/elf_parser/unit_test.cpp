@@ -1,6 +1,7 @@
 // generic C
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 
 // Google Test library
 #include <gtest/gtest.h>
@@ -28,6 +29,66 @@ TEST( Elf_parser_init, Process_Wrong_Args_Of_Constr)
                  ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
 }
 
+//
+// Check that PT_LOAD segments are read with the same bytes as sections.
+//
+TEST( Elf_parser_load, Read_Load_Segments)
+{
+    vector<ElfSection> segments;
+    ASSERT_EQ( ElfSection::getLoadSegments( valid_elf_file, segments), 0x4000b0u);
+    ASSERT_EQ( segments.size(), 2u);
+    ASSERT_EQ( segments[ 0].start_addr, 0x400000u);
+    ASSERT_EQ( segments[ 0].size, 0xc0u);
+    ASSERT_EQ( segments[ 1].start_addr, 0x4100c0u);
+    ASSERT_EQ( segments[ 1].size, 0xc0u);
+
+    vector<ElfSection> sections;
+    ElfSection::getAllElfSections( valid_elf_file, sections);
+    for ( size_t i = 0; i < sections.size(); ++i)
+    {
+        const ElfSection& segment = sections[ i].start_addr < segments[ 1].start_addr
+                                    ? segments[ 0] : segments[ 1];
+        uint64 offset = sections[ i].start_addr - segment.start_addr;
+        ASSERT_EQ( memcmp( segment.content + offset, sections[ i].content,
+                           sections[ i].file_size), 0) << sections[ i].name;
+    }
+
+    // all of them share the mapped file
+    const ElfImage* image = segments[ 0].getImage();
+    ASSERT_TRUE( image != NULL);
+    ASSERT_EQ( segments[ 0].content, image->getData());
+    ASSERT_EQ( segments[ 1].content, image->getData() + 0xc0);
+    ASSERT_NE( sections[ 0].getImage(), image); // mapped once per call
+    ASSERT_EQ( sections[ 1].getImage(), sections[ 0].getImage());
+
+    // moving a section does not copy its content
+    const uint8* content = segments[ 0].content;
+    ElfSection moved( std::move( segments[ 0]));
+    ASSERT_EQ( moved.content, content);
+    ASSERT_TRUE( segments[ 0].content == NULL);
+    segments[ 0] = std::move( moved);
+    ASSERT_EQ( segments[ 0].content, content);
+}
+
+//
+// Check lookup of code symbols, "__start" has no size and lasts
+// till the end of ".text", data labels are not in the index.
+//
+TEST( Elf_parser_symbols, Find_Symbol)
+{
+    ElfSymbolIndex symbols( valid_elf_file);
+    ASSERT_EQ( symbols.size(), 1u);
+    ASSERT_EQ( symbols[ 0].name, "__start");
+    ASSERT_EQ( symbols[ 0].addr, 0x4000b0u);
+    ASSERT_EQ( symbols[ 0].size, 0x10u);
+
+    ASSERT_EQ( symbols.find( 0x4000b0), 0u);
+    ASSERT_EQ( symbols.find( 0x4000bc), 0u);
+    ASSERT_EQ( symbols.find( 0x4000c0), symbols.size());
+    ASSERT_EQ( symbols.find( 0x4000ac), symbols.size());
+    ASSERT_EQ( symbols.find( 0x4100c0), symbols.size());
+}
+
 int main( int argc, char* argv[])
 {
     ::testing::InitGoogleTest( &argc, argv);
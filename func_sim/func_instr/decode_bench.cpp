@@ -0,0 +1,51 @@
+/*
+ * decode_bench.cpp - microbenchmark of mips instruction decoding
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#include <cstdlib>
+#include <ctime>
+
+#include <iostream>
+
+#include <func_instr.h>
+
+// instruction mix of a typical loop: arithmetic, shifts, loads/stores, branches
+static const uint32 instrs[] =
+{
+    0x3c100041, 0x34110000, 0x34080000, 0x34090010, 0x340a0000, 0x02005825,
+    0x8d6c0000, 0x014c5021, 0x000c68c0, 0x01aa7026, 0x31ce00ff, 0xad6e0040,
+    0x256b0004, 0x25080001, 0x0109782a, 0x1509fff6, 0x92040080, 0x96050082,
+    0xa20a0084, 0xa60a0086, 0x000a3042, 0x000a3883, 0x008a1004, 0x008a1806,
+    0x01449027, 0x01449822, 0x0145a023, 0x29550064, 0x2d5600c8, 0x0145b82b,
+    0x22310001, 0x3c180040, 0x371800b0, 0x03000008, 0x1000ffdf, 0x0351d021,
+    0x3b5b0055, 0x08100022, 0x01090018, 0x00004010, 0x0109001a, 0x00004812
+};
+static const size_t instrs_num = sizeof( instrs) / sizeof( instrs[0]);
+
+int main( int argc, char* argv[])
+{
+    if ( argc > 2)
+    {
+        std::cerr << "ERROR: Wrong number of arguments! Optional argument "
+                  << "is the number of passes over the instruction mix." << std::endl;
+        std::exit( EXIT_FAILURE);
+    }
+    uint32 passes = ( argc == 2) ? std::atoi( argv[ 1]) : 1000000;
+
+    uint32 checksum = 0;
+    std::clock_t start = std::clock();
+    for ( uint32 i = 0; i < passes; ++i)
+        for ( size_t j = 0; j < instrs_num; ++j)
+        {
+            FuncInstr instr( instrs[ j], 0x400000 + j * 4);
+            checksum += instr.get_dst_num() + instr.get_new_PC();
+        }
+    double seconds = double( std::clock() - start) / CLOCKS_PER_SEC;
+
+    double decodes = double( passes) * instrs_num;
+    std::cout << "decoded " << decodes << " instructions in " << seconds << " s: "
+              << decodes / seconds << " decodes/s (checksum "
+              << std::hex << checksum << std::dec << ")" << std::endl;
+    return 0;
+}
@@ -26,7 +26,7 @@ int main( int argc, char* argv[])
     ElfSection::getAllElfSections( argv[1], section);
     size_t i;
     for ( i = 0; i < section.size(); i++)
-        if ( !strcmp( section[i].name, argv[2]))
+        if ( section[i].name == argv[2])
             break;
 
     if ( i == section.size())
@@ -35,11 +35,13 @@ int main( int argc, char* argv[])
         std::exit(EXIT_FAILURE);
     }
 
+    // words are read from the mapped file, ".bss" has none of them
+    const uint32* words = reinterpret_cast<const uint32*>( section[i].content);
     bool skip_mode = false;
     size_t j = 0;
-    do
+    while (j < section[i].file_size / 4)
     {
-        uint32 content = ((uint32*) section[i].content)[j];
+        uint32 content = words[j];
         if (content == 0x0) {
             ++j;
             if (!skip_mode){
@@ -52,13 +54,13 @@ int main( int argc, char* argv[])
             skip_mode = false;
         }
 
-        FuncInstr instr((( uint32*) section[i].content)[j]);
+        FuncInstr instr(content);
         std::cout << std::hex << std::setfill( '0')
                   << "0x" << std::setw( 8)
 		  << ( section[i].start_addr + ( j * 4))
 	          << '\t' << instr << std::dec << std::endl;
 	    ++j;
-    } while (j < section[i].size / 4);
+    }
 
     return 0;
 }
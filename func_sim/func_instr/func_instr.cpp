@@ -10,85 +10,124 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <type_traits>
 
 #include <func_instr.h>
 
-const FuncInstr::ISAEntry FuncInstr::isaTable[] =
+// instructions are copied through ports, it must stay a plain memcpy
+static_assert( std::is_trivially_copyable<FuncInstr>::value,
+               "FuncInstr must not own heap memory");
+
+constexpr FuncInstr::ISAEntry FuncInstr::isaTable[] =
 {
-    // name    funct    format    operation   memsize           pointer
-    { "add",    0x20,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_add},
-    { "addu",   0x21,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_addu},
-    { "sub",    0x22,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_sub},
-    { "subu",   0x23,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_subu},
-    { "addi",   0x8,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_addi},
-    { "addiu",  0x9,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_addiu},
-
-    // name    funct    format    operation   memsize           pointer
-    { "mult",   0x18,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mult}, 
-    { "multu",  0x19,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_multu},
-
-    // name    funct    format    operation   memsize           pointer
-    { "div",    0x1A,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_div},
-    { "divu",   0x1B,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_divu},
-
-    // name    funct    format    operation   memsize           pointer
-    { "mfhi",   0x10,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mfhi},
-    { "mflo",   0x12,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mflo},
-    { "mthi",   0x11,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mthi},
-    { "mtlo",   0x13,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mtlo},
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "add",    0x20,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_add,            OP_ADD},
+    { "addu",   0x21,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_addu,           OP_ADDU},
+    { "sub",    0x22,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_sub,            OP_SUB},
+    { "subu",   0x23,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_subu,           OP_SUBU},
+    { "addi",   0x8,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_addi,           OP_ADDI},
+    { "addiu",  0x9,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_addiu,          OP_ADDIU},
+
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "mult",   0x18,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mult,           OP_MULT}, 
+    { "multu",  0x19,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_multu,          OP_MULT},
+
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "div",    0x1A,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_div,            OP_DIV},
+    { "divu",   0x1B,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_divu,           OP_DIV},
+
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "mfhi",   0x10,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mfhi,           OP_MFHI},
+    { "mflo",   0x12,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mflo,           OP_MFLO},
+    { "mthi",   0x11,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mthi,           OP_MTHI},
+    { "mtlo",   0x13,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_mtlo,           OP_MTLO},
     
-    // name    funct    format    operation   memsize           pointer
-    { "sll",    0x0,   FORMAT_R, OUT_R_SHAMT,   0, &FuncInstr::execute_sll},
-    { "srl",    0x2,   FORMAT_R, OUT_R_SHAMT,   0, &FuncInstr::execute_srl},
-    { "sra",    0x3,   FORMAT_R, OUT_R_SHAMT,	0, &FuncInstr::execute_sra},
-    { "sllv",   0x4,   FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_sllv},
-    { "srlv",   0x6,   FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_srlv},
-    { "srav",   0x7,   FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_srav},
-    { "lui",    0xF,   FORMAT_I, OUT_I_CONST,   0, &FuncInstr::execute_lui},
-    { "slt",    0x2A,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_slt},
-    { "sltu",   0x2B,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_sltu},
-    { "slti",   0xA,   FORMAT_I, OUT_I_ARITHM,	0, &FuncInstr::execute_slti},
-    { "sltiu",  0xB,   FORMAT_I, OUT_I_ARITHM,	0, &FuncInstr::execute_sltiu},
-
-    // name    funct    format    operation   memsize           pointer
-    { "and",    0x24,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_and},
-    { "or",     0x25,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_or},
-    { "xor",    0x26,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_xor},
-    { "nor",    0x27,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_nor},
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "sll",    0x0,   FORMAT_R, OUT_R_SHAMT,   0, &FuncInstr::execute_sll,            OP_SLL},
+    { "srl",    0x2,   FORMAT_R, OUT_R_SHAMT,   0, &FuncInstr::execute_srl,            OP_SRL},
+    { "sra",    0x3,   FORMAT_R, OUT_R_SHAMT,	0, &FuncInstr::execute_sra,            OP_SRL},
+    { "sllv",   0x4,   FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_sllv,           OP_SLLV},
+    { "srlv",   0x6,   FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_srlv,           OP_SRLV},
+    { "srav",   0x7,   FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_srav,           OP_SRLV},
+    { "lui",    0xF,   FORMAT_I, OUT_I_CONST,   0, &FuncInstr::execute_lui,            OP_LUI},
+    { "slt",    0x2A,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_slt,            OP_SLT},
+    { "sltu",   0x2B,  FORMAT_R, OUT_R_ARITHM,	0, &FuncInstr::execute_sltu,           OP_SLT},
+    { "slti",   0xA,   FORMAT_I, OUT_I_ARITHM,	0, &FuncInstr::execute_slti,           OP_SLTI},
+    { "sltiu",  0xB,   FORMAT_I, OUT_I_ARITHM,	0, &FuncInstr::execute_sltiu,          OP_SLTI},
+
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "and",    0x24,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_and,            OP_AND},
+    { "or",     0x25,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_or,             OP_OR},
+    { "xor",    0x26,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_xor,            OP_XOR},
+    { "nor",    0x27,  FORMAT_R, OUT_R_ARITHM,  0, &FuncInstr::execute_nor,            OP_NOR},
     
-    // name    funct    format    operation   memsize           pointer
-    { "andi",   0xC,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_andi},
-    { "ori",    0xD,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_ori},
-    { "xori",   0xE,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_xori},
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "andi",   0xC,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_andi,           OP_ANDI},
+    { "ori",    0xD,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_ori,            OP_ORI},
+    { "xori",   0xE,   FORMAT_I, OUT_I_ARITHM,  0, &FuncInstr::execute_xori,           OP_XORI},
     
-    // name    funct    format    operation   memsize           pointer
-    { "beq",    0x4,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_beq},
-    { "bne",    0x5,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_bne},
-    { "blez",   0x6,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_blez},
-    { "bgtz",   0x7,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_bgtz},
-    { "jal",    0x3,   FORMAT_J, OUT_J_JUMP,    0, &FuncInstr::execute_jal},
-    { "j",      0x2,   FORMAT_J, OUT_J_JUMP,    0, &FuncInstr::execute_j},
-    { "jr",     0x8,   FORMAT_R, OUT_R_JUMP,    0, &FuncInstr::execute_jr},
-    { "jalr",   0x9,   FORMAT_R, OUT_R_JUMP,    0, &FuncInstr::execute_jalr},
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "beq",    0x4,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_beq,            OP_BEQ},
+    { "bne",    0x5,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_bne,            OP_BNE},
+    { "blez",   0x6,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_blez,           OP_BLEZ},
+    { "bgtz",   0x7,   FORMAT_I, OUT_I_BRANCH,  0, &FuncInstr::execute_bgtz,           OP_BGTZ},
+    { "jal",    0x3,   FORMAT_J, OUT_J_JUMP,    0, &FuncInstr::execute_jal,            OP_JAL},
+    { "j",      0x2,   FORMAT_J, OUT_J_JUMP,    0, &FuncInstr::execute_j,              OP_J},
+    { "jr",     0x8,   FORMAT_R, OUT_R_JUMP,    0, &FuncInstr::execute_jr,             OP_JR},
+    { "jalr",   0x9,   FORMAT_R, OUT_R_JUMP,    0, &FuncInstr::execute_jalr,           OP_JALR},
     
-    // name    funct    format    operation   memsize           pointer
-    { "lb",     0x20,  FORMAT_I, OUT_I_LOAD,    1, &FuncInstr::calculate_load_addr},
-    { "lbu",    0x24,  FORMAT_I, OUT_I_LOADU,   1, &FuncInstr::calculate_load_addr},
-    { "lh",     0x21,  FORMAT_I, OUT_I_LOAD,    2, &FuncInstr::calculate_load_addr},
-    { "lhu",    0x25,  FORMAT_I, OUT_I_LOADU,   2, &FuncInstr::calculate_load_addr},
-    { "lw",     0x23,  FORMAT_I, OUT_I_LOAD,    4, &FuncInstr::calculate_load_addr},
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "lb",     0x20,  FORMAT_I, OUT_I_LOAD,    1, &FuncInstr::calculate_load_addr,    OP_LOAD},
+    { "lbu",    0x24,  FORMAT_I, OUT_I_LOADU,   1, &FuncInstr::calculate_load_addr,    OP_LOAD},
+    { "lh",     0x21,  FORMAT_I, OUT_I_LOAD,    2, &FuncInstr::calculate_load_addr,    OP_LOAD},
+    { "lhu",    0x25,  FORMAT_I, OUT_I_LOADU,   2, &FuncInstr::calculate_load_addr,    OP_LOAD},
+    { "lw",     0x23,  FORMAT_I, OUT_I_LOAD,    4, &FuncInstr::calculate_load_addr,    OP_LOAD},
     
-    // name    funct    format    operation   memsize           pointer
-    { "sb",     0x28,  FORMAT_I, OUT_I_STORE,   1, &FuncInstr::calculate_store_addr},
-    { "sh",     0x29,  FORMAT_I, OUT_I_STORE,   2, &FuncInstr::calculate_store_addr},
-    { "sw",     0x2B,  FORMAT_I, OUT_I_STORE,   4, &FuncInstr::calculate_store_addr},
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "sb",     0x28,  FORMAT_I, OUT_I_STORE,   1, &FuncInstr::calculate_store_addr,   OP_STORE},
+    { "sh",     0x29,  FORMAT_I, OUT_I_STORE,   2, &FuncInstr::calculate_store_addr,   OP_STORE},
+    { "sw",     0x2B,  FORMAT_I, OUT_I_STORE,   4, &FuncInstr::calculate_store_addr,   OP_STORE},
     
-    // name    funct    format    operation   memsize           pointer
-    { "break",  0xD,   FORMAT_R, OUT_R_SPECIAL, 0, &FuncInstr::execute_break},
-    { "syscall",0xC,   FORMAT_R, OUT_R_SPECIAL, 0, &FuncInstr::execute_syscall},
-    { "trap",   0x1A,  FORMAT_J, OUT_J_SPECIAL, 0, &FuncInstr::execute_trap},
+    // name    funct    format    operation   memsize           pointer                 kind
+    { "break",  0xD,   FORMAT_R, OUT_R_SPECIAL, 0, &FuncInstr::execute_break,          OP_NOP},
+    { "syscall",0xC,   FORMAT_R, OUT_R_SPECIAL, 0, &FuncInstr::execute_syscall,        OP_NOP},
+    { "trap",   0x1A,  FORMAT_J, OUT_J_SPECIAL, 0, &FuncInstr::execute_trap,           OP_NOP},
 };                                              
-const uint32 FuncInstr::isaTableSize = sizeof(isaTable) / sizeof(isaTable[0]);
+constexpr uint32 FuncInstr::isaTableSize = sizeof(isaTable) / sizeof(isaTable[0]);
+
+/*
+ * Builds FuncInstr decode tables from isaTable during compilation:
+ * entry[i] is the index of the isaTable entry with opcode (or funct) i.
+ */
+struct DecodeTableGenerator
+{
+    template<size_t... I> struct IndexList { };
+    template<size_t N, size_t... I> struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> { };
+    template<size_t... I> struct MakeIndexList<0, I...> { typedef IndexList<I...> type; };
+    typedef MakeIndexList<sizeof( FuncInstr::DecodeTable().entry)>::type AllIdents;
+
+    static_assert( FuncInstr::isaTableSize < FuncInstr::NO_ISA_ENTRY,
+                   "isaTable index must fit into decode table entry");
+
+    static constexpr uint8 find( bool is_R, uint8 ident, uint32 i)
+    {
+        return i == FuncInstr::isaTableSize ? FuncInstr::NO_ISA_ENTRY
+             : FuncInstr::isaTable[i].opcode == ident &&
+               ( FuncInstr::isaTable[i].format == FuncInstr::FORMAT_R) == is_R ? i
+             : find( is_R, ident, i + 1);
+    }
+
+    template<size_t... I>
+    static constexpr FuncInstr::DecodeTable generate( bool is_R, IndexList<I...>)
+    {
+        return FuncInstr::DecodeTable{ { find( is_R, I, 0)... } };
+    }
+};
+
+constexpr FuncInstr::DecodeTable FuncInstr::opcodeTable =
+    DecodeTableGenerator::generate( false, DecodeTableGenerator::AllIdents());
+constexpr FuncInstr::DecodeTable FuncInstr::functTable =
+    DecodeTableGenerator::generate( true, DecodeTableGenerator::AllIdents());
 
 const char *FuncInstr::regTable[REG_NUM_MAX] = 
 {
@@ -131,77 +170,97 @@ FuncInstr::FuncInstr( uint32 bytes, uint32 PC) : instr(bytes), PC(PC)
             break;
     }
     new_PC = PC + 4;
+    predicted_PC = new_PC;
 }
 
 std::string FuncInstr::Dump( std::string indent) const
 {
     ostringstream oss;
-    oss << indent << disasm;
-    
+    oss << indent;
+    Dump( oss);
+    return oss.str();
+}
+
+std::ostream& FuncInstr::Dump( std::ostream& out) const
+{
+    printDisasm( out);
+
     if ( dst != REG_NUM_ZERO && complete)
     {
-        oss << "\t [ $" << regTableName(dst) 
+        out << "\t [ $" << regTableName(dst)
             << " = 0x" << std::hex << v_dst << "]" << std::dec;
     }
-    return oss.str();
+    return out;
 }
 
-void FuncInstr::initFormat()
+uint8 FuncInstr::lookupISAEntry( _instr instr)
 {
     bool is_R = ( instr.asR.opcode == 0x0);
-    uint8 ident = is_R ? instr.asR.funct : instr.asR.opcode;
+    return is_R ? functTable.entry[ instr.asR.funct]
+                : opcodeTable.entry[ instr.asR.opcode];
+}
+
+bool FuncInstr::is_known( uint32 bytes)
+{
+    return lookupISAEntry( _instr( bytes)) != NO_ISA_ENTRY;
+}
 
-    for ( size_t i = 0; i < isaTableSize; i++)
+uint32 FuncInstr::get_isa_signature()
+{
+    // FNV-1a over the fields defining decoded objects
+    uint32 hash = 2166136261u;
+    uint32 fields[] = { sizeof( FuncInstr), isaTableSize };
+    for ( size_t i = 0; i < sizeof( fields) / sizeof( fields[ 0]); ++i)
+        hash = ( hash ^ fields[ i]) * 16777619u;
+    for ( size_t i = 0; i < isaTableSize; ++i)
     {
-        bool is_i_R = ( isaTable[i].format == FORMAT_R);
-        if ( isaTable[i].opcode == ident && ( is_i_R == is_R))
-        {
-            format    = isaTable[i].format;
-            operation = isaTable[i].operation;
-            mem_size  = isaTable[i].mem_size;
-            isaNum    = i;
-            if ( FORMAT_R == format)
-               assert( instr.asR.opcode == 0x0);
-            return;
-        }
+        const ISAEntry& entry = isaTable[ i];
+        for ( const char* c = entry.name; *c != '\0'; ++c)
+            hash = ( hash ^ uint8( *c)) * 16777619u;
+        uint32 values[] = { entry.opcode, entry.format, entry.operation, entry.mem_size,
+                            entry.kind };
+        for ( size_t j = 0; j < sizeof( values) / sizeof( values[ 0]); ++j)
+            hash = ( hash ^ values[ j]) * 16777619u;
     }
-    initUnknown();
+    return hash;
+}
+
+void FuncInstr::initFormat()
+{
+    uint8 entry = lookupISAEntry( instr);
+    if ( entry == NO_ISA_ENTRY)
+    {
+        initUnknown();
+        return;
+    }
+
+    format    = isaTable[entry].format;
+    operation = isaTable[entry].operation;
+    mem_size  = isaTable[entry].mem_size;
+    isaNum    = entry;
 }
 
 
 void FuncInstr::initR()
 {
-    ostringstream oss;
-    oss << isaTable[isaNum].name;
     switch ( operation)
     {
         case OUT_R_ARITHM:
             src2 = (RegNum)instr.asR.rt;
             src1 = (RegNum)instr.asR.rs;
             dst  = (RegNum)instr.asR.rd;
-
-            oss <<  " $" << regTableName(dst) 
-                << ", $" << regTableName(src1)
-                << ", $" << regTableName(src2);
             break;
         case OUT_R_SHAMT:
             src1  = (RegNum)instr.asR.rs;
             dst   = (RegNum)instr.asR.rd;
             v_imm = instr.asR.shamt;
-
-            oss <<  " $" << regTableName(dst)
-                << ", $" << regTableName(src1)
-                <<  ", " << dec << v_imm;
             break;
         case OUT_R_JUMP:
             src1  = (RegNum)instr.asR.rs;
-
-            oss << " $" << regTableName(src1);
             break;
         case OUT_R_SPECIAL:
             break;
     }
-    disasm = oss.str();
 }
 
 
@@ -209,81 +268,115 @@ void FuncInstr::initI()
 {
     v_imm = instr.asI.imm;
 
-    std::ostringstream oss;
-    oss << isaTable[isaNum].name << " $";
     switch ( operation)
     {
         case OUT_I_ARITHM:
             src1 = (RegNum)instr.asI.rs;
             dst  = (RegNum)instr.asI.rt;
-
-            oss << regTable[dst] << ", $"
-                << regTable[src1] << ", "
-                << std::hex << "0x" << v_imm << std::dec;
-            
             break;
         case OUT_I_BRANCH:
             src1 = (RegNum)instr.asI.rs;
             src2 = (RegNum)instr.asI.rt;
-
-            oss << regTable[src1] << ", $"
-                << regTable[src2] << ", "
-                << std::hex << "0x" << v_imm << std::dec;
             break;
-
         case OUT_I_CONST:
             dst  = (RegNum)instr.asI.rt;
-
-            oss << regTable[dst] << std::hex 
-                << ", 0x" << v_imm << std::dec;
             break;
-
         case OUT_I_LOAD:
         case OUT_I_LOADU:
             src1 = (RegNum)instr.asI.rs;
             dst  = (RegNum)instr.asI.rt;
-            
-            oss << regTable[dst] << ", 0x"
-                << std::hex << v_imm
-                << "($" << regTable[src1] << ")" << std::dec;
             break;
-        
         case OUT_I_STORE:
             src2 = (RegNum)instr.asI.rt;
             src1  = (RegNum)instr.asI.rs;
             dst  = REG_NUM_ZERO;
-
-            oss << regTable[src2] << ", 0x"
-                << std::hex << v_imm
-                << "($" << regTable[src1] << ")" << std::dec;
             break;
     }
-    disasm = oss.str();
 }
 
 void FuncInstr::initJ()
 {
     dst   = REG_NUM_ZERO;
     v_imm = instr.asJ.imm;
-
-    std::ostringstream oss;
-    oss << isaTable[isaNum].name << " "
-        << std::hex << "0x" <<instr.asJ.imm;
-    disasm = oss.str();
 }
 
 void FuncInstr::initUnknown()
 {
+    format = FORMAT_UNKNOWN;
     std::ostringstream oss;
-    oss << std::hex << std::setfill( '0')
-        << "0x" << std::setw( 8) << instr.raw << '\t' << "Unknown" << std::endl;
-    disasm = oss.str();
-    std::cerr << "ERROR.Incorrect instruction: " << disasm << std::endl;
+    printDisasm( oss);
+    std::cerr << "ERROR.Incorrect instruction: " << oss.str() << std::endl;
     exit(EXIT_FAILURE);
 }
 
+/*
+ * Disassembly is produced only on demand from the raw encoding
+ * and the decoded fields, so decoding does not format strings.
+ */
+void FuncInstr::printDisasm( std::ostream& oss) const
+{
+    if ( format == FORMAT_UNKNOWN)
+    {
+        oss << std::hex << std::setfill( '0')
+            << "0x" << std::setw( 8) << instr.raw << '\t' << "Unknown" << std::endl
+            << std::setfill( ' ') << std::dec;
+        return;
+    }
+
+    oss << isaTable[isaNum].name;
+    switch ( operation)
+    {
+        case OUT_R_ARITHM:
+            oss <<  " $" << regTableName(dst)
+                << ", $" << regTableName(src1)
+                << ", $" << regTableName(src2);
+            break;
+        case OUT_R_SHAMT:
+            oss <<  " $" << regTableName(dst)
+                << ", $" << regTableName(src1)
+                <<  ", " << dec << v_imm;
+            break;
+        case OUT_R_JUMP:
+            oss << " $" << regTableName(src1);
+            break;
+        case OUT_R_SPECIAL:
+            break;
+
+        case OUT_I_ARITHM:
+            oss << " $" << regTable[dst] << ", $"
+                << regTable[src1] << ", "
+                << std::hex << "0x" << v_imm << std::dec;
+            break;
+        case OUT_I_BRANCH:
+            oss << " $" << regTable[src1] << ", $"
+                << regTable[src2] << ", "
+                << std::hex << "0x" << v_imm << std::dec;
+            break;
+        case OUT_I_CONST:
+            oss << " $" << regTable[dst] << std::hex
+                << ", 0x" << v_imm << std::dec;
+            break;
+        case OUT_I_LOAD:
+        case OUT_I_LOADU:
+            oss << " $" << regTable[dst] << ", 0x"
+                << std::hex << v_imm
+                << "($" << regTable[src1] << ")" << std::dec;
+            break;
+        case OUT_I_STORE:
+            oss << " $" << regTable[src2] << ", 0x"
+                << std::hex << v_imm
+                << "($" << regTable[src1] << ")" << std::dec;
+            break;
+
+        case OUT_J_JUMP:
+        case OUT_J_SPECIAL:
+            oss << " " << std::hex << "0x" << instr.asJ.imm << std::dec;
+            break;
+    }
+}
+
 std::ostream& operator<< ( std::ostream& out, const FuncInstr& instr)
 {
-    return out << instr.Dump( "");
+    return instr.Dump( out);
 }
 
@@ -11,6 +11,7 @@
 
 // Generic C++
 #include <string>
+#include <iostream>
 #include <cassert>
 
 // MIPT-MIPS modules
@@ -54,6 +55,21 @@ enum RegNum
     REG_NUM_MAX
 };
 
+/*
+ * Operations of the engines executing w/o FuncInstr objects,
+ * instructions with the same semantics share an operation.
+ */
+enum OpKind
+{
+    OP_ADD, OP_ADDU, OP_SUB, OP_SUBU, OP_ADDI, OP_ADDIU,
+    OP_MULT, OP_DIV, OP_MFHI, OP_MTHI, OP_MFLO, OP_MTLO,
+    OP_SLL, OP_SRL, OP_SLLV, OP_SRLV, OP_LUI, OP_SLT, OP_SLTI,
+    OP_AND, OP_OR, OP_XOR, OP_NOR, OP_ANDI, OP_ORI, OP_XORI,
+    OP_BEQ, OP_BNE, OP_BLEZ, OP_BGTZ, OP_J, OP_JAL, OP_JR, OP_JALR,
+    OP_NOP, OP_LOAD, OP_STORE,
+    OP_KINDS_NUM
+};
+
 class FuncInstr
 {
     private:
@@ -114,7 +130,7 @@ class FuncInstr
 
         struct ISAEntry
         {
-            std::string name;
+            const char* name;
 
             uint8 opcode;
 
@@ -124,11 +140,28 @@ class FuncInstr
             uint8 mem_size;
 
             void (FuncInstr::*function)(void);
+
+            OpKind kind;
         };
         uint32 isaNum;
 
         static const ISAEntry isaTable[];
         static const uint32 isaTableSize;
+
+        /*
+         * Direct-lookup decode tables generated from isaTable at compile time,
+         * one per 6-bit instruction field. REGIMM or COP tables can be added
+         * in the same way (see DecodeTableGenerator in func_instr.cpp).
+         */
+        static const uint8 NO_ISA_ENTRY = 0xFF;
+        struct DecodeTable
+        {
+            uint8 entry[ 1 << 6];
+        };
+        static const DecodeTable opcodeTable; // I and J formats, by opcode
+        static const DecodeTable functTable;  // R format (opcode 0), by funct
+        friend struct DecodeTableGenerator;
+        static uint8 lookupISAEntry( _instr instr);
         static const char *regTableName(RegNum);
         static const char *regTable[];
 
@@ -147,14 +180,14 @@ class FuncInstr
 
         uint32 PC; // removing "const" keyword to supporting ports
         uint32 new_PC;
+        uint32 predicted_PC; // fetched after it by a pipelined simulator
 
-        std::string disasm;
-                                                               
         void initFormat();
         void initR();
         void initI();
         void initJ();
         void initUnknown();
+        void printDisasm( std::ostream& out) const;
 
         void execute_add()   { v_dst = (int32)v_src1 + (int32)v_src2; }
         void execute_addu()  { v_dst = v_src1 + v_src2; }
@@ -218,6 +251,32 @@ class FuncInstr
         FuncInstr() {} // constructor w/o arguments for ports
         FuncInstr( uint32 bytes, uint32 PC = 0);
         std::string Dump( std::string indent = " ") const;
+        std::ostream& Dump( std::ostream& out) const;
+
+        /* Checks if bytes encode a supported instruction (without exiting). */
+        static bool is_known( uint32 bytes);
+
+        /*
+         * Hash of the ISA table and of the object layout. Decoded objects
+         * saved to a file may be used only by a simulator with the same one.
+         */
+        static uint32 get_isa_signature();
+
+        const char* get_name() const { return isaTable[isaNum].name; }
+        OpKind get_op_kind() const { return isaTable[isaNum].kind; }
+        uint32 get_PC()    const { return PC; }
+        uint32 get_bytes() const { return instr.raw; }
+        uint32 get_v_imm() const { return v_imm; }
+
+        /* Immediate with branch and jump targets calculated from PC. */
+        uint32 get_target_imm() const
+        {
+            if ( operation == OUT_I_BRANCH)
+                return PC + 4 + ( (int16)v_imm << 2);
+            if ( operation == OUT_J_JUMP)
+                return ( PC & 0xF0000000) | ( v_imm << 2);
+            return v_imm;
+        }
 
         RegNum get_src1_num() const { return src1; }
         RegNum get_src2_num() const { return src2; }
@@ -230,6 +289,18 @@ class FuncInstr
         bool is_load()  const { return operation == OUT_I_LOAD || operation == OUT_I_LOADU; }
         bool is_store() const { return operation == OUT_I_STORE; }
 
+        /* Kinds of jumps for branch prediction. */
+        bool is_branch() const { return operation == OUT_I_BRANCH; } // conditional one
+        bool is_call() const { return ( operation == OUT_J_JUMP && instr.asJ.opcode == 0x3) ||
+                                      ( operation == OUT_R_JUMP && instr.asR.funct == 0x9); }
+        bool is_return() const { return operation == OUT_R_JUMP && !is_call() &&
+                                        src1 == REG_NUM_RA; }
+
+        /* PC of the next instruction taken by fetch, PC + 4 by default. */
+        void set_predicted_PC( uint32 value) { predicted_PC = value; }
+        uint32 get_predicted_PC() const { return predicted_PC; }
+        bool is_misprediction() const { return predicted_PC != new_PC; }
+
         void set_v_src1(uint32 value) { v_src1 = value; }
         void set_v_src2(uint32 value) { v_src2 = value; }
 
@@ -240,6 +311,9 @@ class FuncInstr
         uint32 get_new_PC() const { return new_PC; }
  
         void set_v_dst(uint32 value)  { v_dst  = value; } // for loads
+
+        /* Sets result of execution made by an engine working w/o FuncInstr objects. */
+        void set_result(uint32 value) { v_dst = value; complete = true; }
         uint32 get_v_src2() const { return v_src2; } // for stores
 	
         void execute() { (this->*isaTable[isaNum].function)(); complete = true; };
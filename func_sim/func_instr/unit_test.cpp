@@ -2,6 +2,9 @@
 #include <cassert>
 #include <cstdlib>
 
+// generic C++
+#include <sstream>
+
 // Google Test library
 #include <gtest/gtest.h>
 
@@ -48,6 +51,29 @@ TEST( Func_instr_J, Process_Disasm)
     ASSERT_EQ( result, master);
 }
 
+TEST( Func_instr_I, Process_Disasm_Stream)
+{
+    // disassembly is printed on demand, stream and string forms must match
+    FuncInstr fi(0x8D6A0004ull);
+    std::ostringstream oss;
+    oss << fi;
+    ASSERT_EQ( oss.str(), fi.Dump(""));
+    ASSERT_EQ( oss.str(), "lw $t2, 0x4($t3)");
+}
+
+TEST( Func_instr_decode, Opcode_And_Funct_Tables)
+{
+    // the same 6-bit value means different instructions in opcode and funct fields
+    ASSERT_EQ( FuncInstr(0x03000008ull).Dump(""), "jr $t8");                // funct 0x08
+    ASSERT_EQ( FuncInstr(0x21080001ull).Dump(""), "addi $t0, $t0, 0x1");    // opcode 0x08
+    ASSERT_EQ( FuncInstr(0xAD6E0040ull).Dump(""), "sw $t6, 0x40($t3)");     // opcode 0x2B
+    ASSERT_EQ( FuncInstr(0x0145B82Bull).Dump(""), "sltu $s7, $t2, $a1");    // funct 0x2B
+
+    // opcode 0x1 (REGIMM) is not supported yet
+    ASSERT_EXIT( FuncInstr fi(0x04010000ull),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+}
+
 int main( int argc, char* argv[])
 {
     ::testing::InitGoogleTest( &argc, argv);
@@ -0,0 +1,111 @@
+/*
+ * arena.h - allocator of zeroed blocks carved from large host mappings
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <iostream>
+#include <vector>
+
+#include <types.h>
+
+/*
+ * Blocks are never freed one by one: all of them are released together
+ * with the arena. Anonymous mappings are zeroed by the kernel on first
+ * touch, so a block is neither cleared nor backed by host memory until
+ * it is written.
+ */
+class Arena
+{
+        static const size_t CHUNK_SIZE = 1 << 20;
+
+        struct Chunk
+        {
+            uint8* data;
+            size_t size;
+        };
+        std::vector<Chunk> chunks;
+
+        uint8* free_ptr; // the rest of the last chunk
+        size_t free_size;
+
+        void add_chunk( size_t size)
+        {
+            void* ptr = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if ( ptr == MAP_FAILED)
+            {
+                std::cerr << "ERROR: Could not allocate guest memory: "
+                          << strerror( errno) << std::endl;
+                exit( EXIT_FAILURE);
+            }
+            Chunk chunk = { static_cast<uint8*>( ptr), size };
+            chunks.push_back( chunk);
+            free_ptr = chunk.data;
+            free_size = size;
+        }
+
+    public:
+        Arena() : free_ptr( NULL), free_size( 0) { }
+
+        ~Arena()
+        {
+            for ( size_t i = 0; i < chunks.size(); ++i)
+            {
+                munmap( chunks[ i].data, chunks[ i].size);
+            }
+        }
+
+        /*
+         * Returns zeroed block of size bytes. Blocks of the same power of two
+         * size are aligned to it up to the host page size.
+         */
+        uint8* alloc( size_t size)
+        {
+            if ( size > free_size)
+            {
+                // blocks larger than a chunk get a mapping of their own,
+                // the rest of the current chunk is left for the next blocks
+                size_t chunk_size = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+                uint8* last_ptr = free_ptr;
+                size_t last_size = free_size;
+                add_chunk( chunk_size);
+                if ( size == chunk_size && last_ptr != NULL)
+                {
+                    uint8* block = free_ptr;
+                    free_ptr = last_ptr;
+                    free_size = last_size;
+                    return block;
+                }
+            }
+            uint8* block = free_ptr;
+            free_ptr += size;
+            free_size -= size;
+            return block;
+        }
+
+        /* Returns size of host memory reserved by the arena. */
+        uint64 get_reserved_size() const
+        {
+            uint64 size = 0;
+            for ( size_t i = 0; i < chunks.size(); ++i)
+            {
+                size += chunks[ i].size;
+            }
+            return size;
+        }
+
+    private:
+        // chunks are owned by the arena
+        Arena( const Arena&);
+        Arena& operator=( const Arena&);
+};
+
+#endif
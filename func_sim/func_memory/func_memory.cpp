@@ -6,9 +6,14 @@
  */
 
 // Generic C
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 // Generic C++
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 
@@ -24,62 +29,297 @@ union uint64_8
 FuncMemory::FuncMemory( const char* executable_file_name,
                         uint64 addr_bits,
                         uint64 page_bits,
-                        uint64 offset_bits) :
+                        uint64 offset_bits,
+                        Backend backend) :
     addr_bits( addr_bits),
     page_bits( page_bits),
     offset_bits( offset_bits),
     set_bits( addr_bits - offset_bits - page_bits),
-    offset_mask( ( 1 << offset_bits) - 1),
-    page_mask ( ( ( 1 << page_bits) - 1) << offset_bits),
-    set_mask ( (( 1 << set_bits) - 1) << ( page_bits + offset_bits))
+    offset_mask( ( 1ull << offset_bits) - 1),
+    page_mask ( ( ( 1ull << page_bits) - 1) << offset_bits),
+    set_mask ( (( 1ull << set_bits) - 1) << ( page_bits + offset_bits))
 {
     assert( executable_file_name);
 
-    memory = new uint8** [1 << set_bits];
-    memset(memory, 0, sizeof(uint8**) * (1 << set_bits));
-    
-    std::vector<ElfSection> sections_array;
-    ElfSection::getAllElfSections( executable_file_name, sections_array);
+    init( backend);
+    map_elf( executable_file_name);
+}
+
+void FuncMemory::map_elf( const char* executable_file_name)
+{
+    std::vector<ElfSection> segments;
+    uint64 start_PC = ElfSection::getLoadSegments( executable_file_name, segments);
+    load_image( segments, start_PC);
+}
 
-    for ( vector<ElfSection>::iterator it = sections_array.begin(); it != sections_array.end(); ++it)
+void FuncMemory::load_image( const std::vector<ElfSection>& sections, uint64 start_PC)
+{
+    startPC_addr = start_PC;
+
+    uint64 page_size = get_page_size();
+    for ( vector<ElfSection>::const_iterator it = sections.begin(); it != sections.end(); ++it)
     {
-        if ( !strcmp( ".text", it->name))
+        if ( it->getImage() != NULL && flat == NULL)
         {
-            startPC_addr = it->start_addr;
+            it->getImage()->ref();
+            storage->elf_images.push_back( it->getImage());
+        }
+
+        // guest pages lying entirely in the section share the mapped file
+        // if the file offset has the same alignment, the rest is copied
+        uint64 addr = it->start_addr;
+        uint64 end = it->start_addr + it->file_size;
+        const uint8* data = it->content;
+        while ( addr < end)
+        {
+            uint64 chunk = std::min( end - addr, page_size - get_offset( addr));
+            bool is_mappable = chunk == page_size && flat == NULL &&
+                               ( reinterpret_cast<uint64>( data) & ( page_size - 1)) == 0 &&
+                               !check( addr);
+            if ( is_mappable)
+            {
+                map_shared_page( addr, data);
+            }
+            else
+            {
+                write_block( addr, data, chunk);
+            }
+            addr += chunk;
+            data += chunk;
         }
-        for ( size_t offset = 0; offset < it->size; ++offset)
+
+        // the tail (".bss") is zero-filled: new pages are zeroed already,
+        // only pages shared with other data are cleared
+        end = it->start_addr + it->size;
+        while ( addr < end)
         {
-            write( it->content[offset], it->start_addr + offset, 1);
+            uint64 chunk = std::min( end - addr, page_size - get_offset( addr));
+            bool has_data = check( addr);
+            alloc( addr);
+            if ( has_data)
+            {
+                memset( find_host_addr( addr), 0, chunk);
+            }
+            addr += chunk;
         }
     }
 }
 
+void FuncMemory::write_block( uint64 addr, const uint8* data, uint64 size)
+{
+    assert( size == 0 || addr != 0);
+
+    // one page allocation and one copy per page-sized chunk
+    uint64 page_size = get_page_size();
+    while ( size != 0)
+    {
+        uint64 chunk = std::min( size, page_size - get_offset( addr));
+        alloc( addr);
+        memcpy( find_page( addr) + get_offset( addr), data, chunk);
+        addr += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+FuncMemory::FuncMemory( uint64 start_PC,
+                        uint64 addr_bits,
+                        uint64 page_bits,
+                        uint64 offset_bits,
+                        Backend backend) :
+    startPC_addr( start_PC),
+    addr_bits( addr_bits),
+    page_bits( page_bits),
+    offset_bits( offset_bits),
+    set_bits( addr_bits - offset_bits - page_bits),
+    offset_mask( ( 1ull << offset_bits) - 1),
+    page_mask ( ( ( 1ull << page_bits) - 1) << offset_bits),
+    set_mask ( (( 1ull << set_bits) - 1) << ( page_bits + offset_bits))
+{
+    init( backend);
+}
+
+void FuncMemory::init( Backend backend)
+{
+    id = new_id();
+    storage = new Storage;
+    pages_num = 0;
+    sets_num = 0;
+    copied_pages_num = 0;
+    epoch = FIRST_EPOCH;
+    host_generation = 0;
+    flush_tlb();
+    if ( backend == BACKEND_TABLES)
+    {
+        flat = NULL;
+        top_bits = set_bits - ( set_bits == 0 ? 0 : ( set_bits - 1) / LEVEL_BITS * LEVEL_BITS);
+        memory = reinterpret_cast<NodeEntry*>( storage->set_arena.alloc( sizeof(NodeEntry) << top_bits));
+        memory_owner = id;
+        return;
+    }
+
+    if ( addr_bits != 32)
+    {
+        cerr << "ERROR: Flat memory backend requires 32-bit addresses" << endl;
+        exit( EXIT_FAILURE);
+    }
+    memory = NULL;
+    flat_mask = ( 1ull << addr_bits) - 1;
+    flat_epochs.assign( 1ull << ( addr_bits - offset_bits), 0);
+
+    // nothing is reserved in swap, host pages appear on first touch
+    void* ptr = mmap( NULL, 1ull << addr_bits, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if ( ptr == MAP_FAILED)
+    {
+        cerr << "ERROR: Could not reserve flat guest memory: " << strerror( errno) << endl;
+        exit( EXIT_FAILURE);
+    }
+    flat = static_cast<uint8*>( ptr);
+
+#ifdef MADV_HUGEPAGE
+    // it is only advice: huge pages are not used if the kernel cannot do it
+    if ( backend == BACKEND_FLAT_THP)
+    {
+        madvise( flat, 1ull << addr_bits, MADV_HUGEPAGE);
+    }
+#endif
+}
+
+FuncMemory::FuncMemory( const FuncMemory& parent) :
+    id( new_id()),
+    memory( parent.memory),
+    memory_owner( parent.memory_owner),
+    top_bits( parent.top_bits),
+    startPC_addr( parent.startPC_addr),
+    flat( NULL),
+    addr_bits( parent.addr_bits),
+    set_bits( parent.set_bits),
+    page_bits( parent.page_bits),
+    offset_bits( parent.offset_bits),
+    set_mask( parent.set_mask),
+    page_mask( parent.page_mask),
+    offset_mask( parent.offset_mask),
+    storage( new Storage),
+    shared_storages( parent.shared_storages),
+    pages_num( parent.pages_num),
+    sets_num( parent.sets_num),
+    copied_pages_num( 0),
+    epoch( parent.epoch),
+    host_generation( 0)
+{
+    shared_storages.push_back( parent.storage);
+    for ( size_t i = 0; i < shared_storages.size(); ++i)
+    {
+        __sync_add_and_fetch( &shared_storages[ i]->refs, 1);
+    }
+    flush_tlb();
+}
+
+FuncMemory* FuncMemory::snapshot()
+{
+    if ( flat != NULL)
+    {
+        cerr << "ERROR: Flat memory backend does not support snapshots" << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    FuncMemory* copy = new FuncMemory( *this);
+    id = new_id(); // nothing is owned by this memory from now on
+    ++host_generation;
+    return copy;
+}
+
+uint32 FuncMemory::new_id()
+{
+    static uint32 last_id = 0;
+    return __sync_add_and_fetch( &last_id, 1);
+}
+
+FuncMemory::Storage::~Storage()
+{
+    for ( size_t i = 0; i < images.size(); ++i)
+    {
+        munmap( images[ i].data, images[ i].size);
+    }
+    for ( size_t i = 0; i < elf_images.size(); ++i)
+    {
+        elf_images[ i]->unref();
+    }
+}
+
+void FuncMemory::release( Storage* storage)
+{
+    if ( __sync_sub_and_fetch( &storage->refs, 1) == 0)
+    {
+        delete storage;
+    }
+}
+
 FuncMemory::~FuncMemory()
 {
-    uint64 set_cnt = 1 << set_bits;
-    uint64 page_cnt = 1 << page_bits;
+    if ( flat != NULL)
+    {
+        munmap( flat, 1ull << addr_bits);
+    }
 
-    for ( size_t set = 0; set < set_cnt; ++set)
+    // tables and pages are freed with their arenas
+    release( storage);
+    for ( size_t i = 0; i < shared_storages.size(); ++i)
     {
-        if (memory[set] != NULL)
+        release( shared_storages[ i]);
+    }
+}
+
+// one host load or store for aligned and unaligned accesses inside a page,
+// data is kept in host byte order like in uint64_8
+static inline uint64 load_host( const uint8* ptr, unsigned short num_of_bytes)
+{
+    switch ( num_of_bytes)
+    {
+        case 1: return *ptr;
+        case 2: { uint16 value; memcpy( &value, ptr, sizeof( value)); return value; }
+        case 4: { uint32 value; memcpy( &value, ptr, sizeof( value)); return value; }
+        case 8: { uint64 value; memcpy( &value, ptr, sizeof( value)); return value; }
+        default:
         {
-            for ( size_t page = 0; page < page_cnt; ++page)
-            {
-                if (memory[set][page] != NULL)
-                {
-                    delete [] memory[set][page];
-                }
-            }
-            delete [] memory[set];
+            uint64_8 value;
+            value.val = 0ull;
+            memcpy( value.bytes, ptr, num_of_bytes);
+            return value.val;
+        }
+    }
+}
+
+static inline void store_host( uint8* ptr, uint64 value, unsigned short num_of_bytes)
+{
+    switch ( num_of_bytes)
+    {
+        case 1: *ptr = value; break;
+        case 2: { uint16 value_ = value; memcpy( ptr, &value_, sizeof( value_)); break; }
+        case 4: { uint32 value_ = value; memcpy( ptr, &value_, sizeof( value_)); break; }
+        case 8: memcpy( ptr, &value, sizeof( value)); break;
+        default:
+        {
+            uint64_8 value_;
+            value_.val = value;
+            memcpy( ptr, value_.bytes, num_of_bytes);
         }
     }
-    delete [] memory;
 }
 
 uint64 FuncMemory::read( uint64 addr, unsigned short num_of_bytes) const
 {
     assert( num_of_bytes <= 8);
     assert( num_of_bytes != 0);
+
+    // fast path: the page is found in TLB or by one table walk
+    uint8* page = find_page( addr);
+    if ( page != NULL && is_inside_page( addr, num_of_bytes))
+    {
+        return load_host( page + get_offset( addr), num_of_bytes);
+    }
+
     assert( check( addr));
     assert( check( addr + num_of_bytes - 1));
 
@@ -98,6 +338,19 @@ void FuncMemory::write( uint64 value, uint64 addr, unsigned short num_of_bytes)
 {
     assert( addr != 0);
     assert( num_of_bytes != 0 );
+
+    if ( is_inside_page( addr, num_of_bytes))
+    {
+        uint8* page = find_page_to_write( addr);
+        if ( page == NULL)
+        {
+            alloc( addr);
+            page = find_page( addr);
+        }
+        store_host( page + get_offset( addr), value, num_of_bytes);
+        return;
+    }
+
     alloc( addr);
     alloc( addr + num_of_bytes - 1);
 
@@ -110,57 +363,291 @@ void FuncMemory::write( uint64 value, uint64 addr, unsigned short num_of_bytes)
     }
 }
 
+FuncMemory::PageEntry& FuncMemory::alloc_entry( uint64 addr)
+{
+    // nodes shared with snapshots are copied on the way to the entry,
+    // TLB may point to the old ones
+    if ( memory_owner != id)
+    {
+        NodeEntry* copy = reinterpret_cast<NodeEntry*>( storage->set_arena.alloc( sizeof(NodeEntry) << top_bits));
+        memcpy( copy, memory, sizeof(NodeEntry) << top_bits);
+        memory = copy;
+        memory_owner = id;
+        flush_tlb();
+    }
+
+    uint64 set = get_set( addr);
+    NodeEntry* node = memory;
+    for ( uint64 shift = set_bits - top_bits; ; shift -= LEVEL_BITS)
+    {
+        NodeEntry& entry = node[ ( set >> shift) & ( ( 1ull << LEVEL_BITS) - 1)];
+        size_t size = shift != 0 ? sizeof(NodeEntry) << LEVEL_BITS : sizeof(PageEntry) << page_bits;
+        if ( entry.child == NULL)
+        {
+            entry.child = storage->set_arena.alloc( size);
+            if ( shift == 0)
+            {
+                ++sets_num;
+            }
+        }
+        else if ( entry.owner != id)
+        {
+            void* copy = storage->set_arena.alloc( size);
+            memcpy( copy, entry.child, size);
+            entry.child = copy;
+            flush_tlb();
+        }
+        entry.owner = id;
+
+        if ( shift == 0)
+        {
+            return static_cast<PageEntry*>( entry.child)[get_page(addr)];
+        }
+        node = static_cast<NodeEntry*>( entry.child);
+    }
+}
+
 void FuncMemory::alloc( uint64 addr)
 {
-    uint8*** set = &memory[get_set(addr)];
-    if ( *set == NULL)
+    if ( flat != NULL)
+    {
+        uint32& page_epoch = get_flat_epoch( addr);
+        if ( page_epoch == 0)
+        {
+            ++pages_num;
+        }
+        page_epoch = epoch;
+        return;
+    }
+
+    PageEntry& page = alloc_entry( addr);
+    if ( page.host_page == NULL)
+    {
+        page.host_page = storage->page_arena.alloc( get_page_size());
+        ++pages_num;
+    }
+    else if ( page.owner != id)
+    {
+        uint8* host_page = storage->page_arena.alloc( get_page_size());
+        memcpy( host_page, page.host_page, get_page_size());
+        page.host_page = host_page;
+        ++copied_pages_num;
+        ++host_generation;
+    }
+    page.owner = id;
+    page.epoch = epoch;
+}
+
+void FuncMemory::flush_tlb()
+{
+    for ( size_t i = 0; i < TLB_SIZE; ++i)
     {
-        *set = new uint8* [1 << page_bits];
-    	memset(*set, 0, sizeof(uint8*) * (1 << page_bits));
+        tlb[ i].page = NULL;
+    }
+}
+
+void FuncMemory::add_image( uint8* data, size_t size)
+{
+    Image image = { data, size };
+    storage->images.push_back( image);
+}
+
+void FuncMemory::map_page( uint64 addr, uint8* host_page)
+{
+    if ( flat != NULL) // the page has its place already
+    {
+        write_block( addr & ~offset_mask, host_page, get_page_size());
+        return;
+    }
+
+    // a frame allocated before stays in the arena
+    PageEntry& page = alloc_entry( addr);
+    page.host_page = host_page;
+    page.owner = id;
+    page.epoch = epoch;
+    ++host_generation;
+}
+
+void FuncMemory::map_shared_page( uint64 addr, const uint8* host_page)
+{
+    if ( flat != NULL)
+    {
+        write_block( addr & ~offset_mask, host_page, get_page_size());
+        return;
+    }
+
+    // no memory owns the page, so a write copies it
+    PageEntry& page = alloc_entry( addr);
+    page.host_page = const_cast<uint8*>( host_page);
+    page.owner = 0;
+    page.epoch = epoch;
+    ++host_generation;
+}
+
+void FuncMemory::get_pages( std::vector<uint64>& addrs) const
+{
+    get_dirty_pages( FIRST_EPOCH, addrs);
+}
+
+void FuncMemory::get_dirty_pages( uint32 since_epoch, std::vector<uint64>& addrs) const
+{
+    assert( since_epoch != 0);
+    if ( flat != NULL)
+    {
+        for ( uint64 page_num = 0; page_num < flat_epochs.size(); ++page_num)
+        {
+            if ( flat_epochs[ page_num] >= since_epoch)
+            {
+                addrs.push_back( page_num << offset_bits);
+            }
+        }
+        return;
     }
-    uint8** page = &memory[get_set(addr)][get_page(addr)];
-    if ( *page == NULL)
+
+    get_dirty_pages( memory, top_bits, set_bits - top_bits, 0, since_epoch, addrs);
+}
+
+void FuncMemory::get_dirty_pages( const NodeEntry* node, uint64 node_bits, uint64 shift,
+                                  uint64 set, uint32 since_epoch,
+                                  std::vector<uint64>& addrs) const
+{
+    for ( uint64 i = 0; i < ( 1ull << node_bits); ++i)
     {
-        *page = new uint8 [1 << offset_bits];
-    	memset(*page, 0, sizeof(uint8) * (1 << offset_bits));
+        if ( node[i].child == NULL)
+        {
+            continue;
+        }
+        if ( shift != 0)
+        {
+            get_dirty_pages( static_cast<const NodeEntry*>( node[i].child), LEVEL_BITS,
+                             shift - LEVEL_BITS, set | ( i << shift), since_epoch, addrs);
+            continue;
+        }
+
+        const PageEntry* pages = static_cast<const PageEntry*>( node[i].child);
+        for ( uint64 page = 0; page < ( 1ull << page_bits); ++page)
+        {
+            if (pages[page].host_page != NULL && pages[page].epoch >= since_epoch)
+            {
+                addrs.push_back( get_addr( set | i, page, 0));
+            }
+        }
     }
 }
 
 bool FuncMemory::check( uint64 addr) const
 {
-    uint8** set = memory[get_set(addr)];
-    return set != NULL && set[get_page(addr)] != NULL;
+    if ( flat != NULL)
+    {
+        return get_flat_epoch( addr) != 0;
+    }
+
+    PageEntry* set = find_set( addr);
+    return set != NULL && set[get_page(addr)].host_page != NULL;
+}
+
+// returns offset of the first nonzero byte in [offset, size) or size,
+// zero words are skipped at once
+static inline uint64 find_nonzero( const uint8* page, uint64 offset, uint64 size)
+{
+    for ( ; offset % sizeof( uint64) != 0 && offset < size; ++offset)
+    {
+        if ( page[offset])
+        {
+            return offset;
+        }
+    }
+    for ( ; offset + sizeof( uint64) <= size; offset += sizeof( uint64))
+    {
+        uint64 word;
+        memcpy( &word, page + offset, sizeof( word));
+        if ( word != 0)
+        {
+            break;
+        }
+    }
+    for ( ; offset < size && !page[offset]; ++offset)
+        ;
+    return offset;
+}
+
+static inline void dump_byte( std::ostream& out, uint64 addr, uint8 value)
+{
+    out << "addr 0x" << addr << ": data 0x" << std::setw( 2) << ( uint32)value << '\n';
 }
 
 string FuncMemory::dump( string indent) const
 {
     std::ostringstream oss;
-    oss << std::setfill( '0') << hex;
-    
-    uint64 set_cnt = 1 << set_bits;
-    uint64 page_cnt = 1 << page_bits;
-    uint64 offset_cnt = 1 << offset_bits;
-    
-    for ( size_t set = 0; set < set_cnt; ++set)
+    dump( oss, FIRST_EPOCH);
+    return oss.str();
+}
+
+void FuncMemory::dump( std::ostream& out, uint32 since_epoch) const
+{
+    std::ios::fmtflags flags = out.flags();
+    char fill = out.fill( '0');
+    out << hex;
+
+    uint64 page_size = get_page_size();
+    std::vector<uint64> pages;
+    get_dirty_pages( since_epoch, pages);
+
+    for ( size_t i = 0; i < pages.size(); ++i)
     {
-        if (memory[set] != NULL)
+        const uint8* page = find_page( pages[ i]);
+        for ( uint64 offset = find_nonzero( page, 0, page_size); offset < page_size;
+              offset = find_nonzero( page, offset + 1, page_size))
         {
-            for ( size_t page = 0; page < page_cnt; ++page)
+            dump_byte( out, pages[ i] + offset, page[offset]);
+        }
+    }
+
+    out.fill( fill);
+    out.flags( flags);
+}
+
+uint64 FuncMemory::diff( std::ostream& out, const FuncMemory& other, uint32 since_epoch) const
+{
+    assert( get_page_size() == other.get_page_size());
+
+    std::vector<uint64> pages;
+    get_dirty_pages( since_epoch, pages);
+    other.get_dirty_pages( since_epoch, pages);
+    std::sort( pages.begin(), pages.end());
+    pages.erase( std::unique( pages.begin(), pages.end()), pages.end());
+
+    std::ios::fmtflags flags = out.flags();
+    char fill = out.fill( '0');
+    out << hex;
+
+    uint64 page_size = get_page_size();
+    std::vector<uint8> zero_page( page_size, 0);
+    uint64 diff_bytes = 0;
+    for ( size_t i = 0; i < pages.size(); ++i)
+    {
+        const uint8* page = find_page( pages[ i]);
+        const uint8* other_page = other.find_page( pages[ i]);
+        page = page != NULL ? page : &zero_page[ 0];
+        other_page = other_page != NULL ? other_page : &zero_page[ 0];
+        if ( memcmp( page, other_page, page_size) == 0)
+        {
+            continue;
+        }
+
+        for ( uint64 offset = 0; offset < page_size; ++offset)
+        {
+            if ( page[offset] != other_page[offset])
             {
-                if (memory[set][page] != NULL)
-                {
-                    for ( size_t offset = 0; offset < offset_cnt; ++offset)
-                    {
-                        if (memory[set][page][offset])
-                        {
-                            oss << "addr 0x" << get_addr( set, page, offset) 
-                                << ": data 0x" << memory[set][page][offset] << std::endl;
-                        }
-                    }
-                }
+                out << "addr 0x" << pages[ i] + offset
+                    << ": data 0x" << std::setw( 2) << ( uint32)page[offset]
+                    << " != 0x" << std::setw( 2) << ( uint32)other_page[offset] << '\n';
+                ++diff_bytes;
             }
         }
     }
 
-    return oss.str();
+    out.fill( fill);
+    out.flags( flags);
+    return diff_bytes;
 }
@@ -12,17 +12,74 @@
 // Generic C++
 #include <string>
 #include <iostream>
+#include <vector>
 #include <cassert>
 
 // uArchSim modules
 #include <types.h>
 #include <elf_parser.h>
+#include <arena.h>
 
 class FuncMemory
 {
+    public:
+        /* Representation of guest memory in the host one. */
+        enum Backend
+        {
+            BACKEND_TABLES,  // pages allocated on demand in set/page tables
+            BACKEND_FLAT,    // 32-bit space reserved as one mapping
+            BACKEND_FLAT_THP // the same with transparent huge pages advised
+        };
+
     private:
-        uint8*** memory;
+        /*
+         * Tables and pages may be shared with snapshots. Each memory marks
+         * what it has allocated or copied with its id, and changes the id
+         * when a snapshot is taken. Anything marked with another id is
+         * copied before the first store to it.
+         */
+        uint32 id;
+        static uint32 new_id();
+
+        // set tables hold host pages with the epoch of their last write
+        struct PageEntry
+        {
+            uint8* host_page; // NULL if the page is not allocated
+            uint32 epoch;
+            uint32 owner;
+        };
+
+        /*
+         * Set tables are leaves of a radix tree indexed by set number, so
+         * host memory is proportional to the touched part of any address
+         * space. The top node takes the high bits left by lower levels,
+         * 32-bit addresses need only it.
+         */
+        static const uint64 LEVEL_BITS = 10;
+        struct NodeEntry
+        {
+            void* child; // NodeEntry or PageEntry array, NULL if not allocated
+            uint32 owner;
+        };
+        NodeEntry* memory; // the top node, NULL for flat backend
+        uint32 memory_owner;
+        uint64 top_bits; // set number bits indexing the top node
         uint64 startPC_addr;
+
+        // flat backend: the host page is base + guest address, the kernel
+        // allocates it on first touch; the epochs of pages written by guest
+        // are kept in a separate array, 0 is for not allocated ones
+        uint8* flat;
+        std::vector<uint32> flat_epochs;
+        inline uint32& get_flat_epoch( uint64 addr)
+        {
+            return flat_epochs[ ( addr & flat_mask) >> offset_bits];
+        }
+        inline uint32 get_flat_epoch( uint64 addr) const
+        {
+            return flat_epochs[ ( addr & flat_mask) >> offset_bits];
+        }
+        uint64 flat_mask; // guest address bits
     
         uint64 addr_bits;
         uint64 set_bits;
@@ -32,6 +89,126 @@ class FuncMemory
         uint64 set_mask;
         uint64 page_mask;
         uint64 offset_mask;        
+
+        // mapped file images
+        struct Image
+        {
+            uint8* data;
+            size_t size;
+        };
+
+        /*
+         * Page frames, tables and images allocated by a memory. They are
+         * released with the last of the memories sharing them.
+         */
+        struct Storage
+        {
+            Arena page_arena;
+            Arena set_arena;
+            std::vector<Image> images;
+            std::vector<ElfImage*> elf_images; // referenced by this storage
+            uint32 refs;
+
+            Storage() : refs( 1) { }
+            ~Storage();
+        };
+        Storage* storage; // allocations of this memory
+        std::vector<Storage*> shared_storages; // those of other memories
+        static void release( Storage* storage);
+
+        uint64 pages_num;
+        uint64 sets_num;
+        uint64 copied_pages_num;
+
+        uint32 epoch; // the current one, marks written pages
+        uint32 host_generation; // see get_host_generation()
+
+        // software TLB: direct-mapped cache of page entries in front of the tables
+        static const size_t TLB_SIZE = 64;
+        struct TLBEntry
+        {
+            uint64 page_num; // addr >> offset_bits
+            PageEntry* page; // NULL if the entry is empty
+        };
+        mutable TLBEntry tlb[ TLB_SIZE];
+        void flush_tlb();
+
+        /* Returns set table containing addr or NULL. Tables only. */
+        inline PageEntry* find_set( uint64 addr) const
+        {
+            uint64 set = get_set( addr);
+            const NodeEntry* node = memory;
+            for ( uint64 shift = set_bits - top_bits; shift != 0; shift -= LEVEL_BITS)
+            {
+                node = static_cast<const NodeEntry*>( node[ ( set >> shift) & ( ( 1ull << LEVEL_BITS) - 1)].child);
+                if ( node == NULL)
+                {
+                    return NULL;
+                }
+            }
+            return static_cast<PageEntry*>( node[ set & ( ( 1ull << LEVEL_BITS) - 1)].child);
+        }
+
+        /* Returns entry of the allocated page containing addr or NULL. Tables only. */
+        inline PageEntry* find_entry( uint64 addr) const
+        {
+            TLBEntry& entry = tlb[ ( addr >> offset_bits) % TLB_SIZE];
+            if ( entry.page != NULL && entry.page_num == addr >> offset_bits)
+            {
+                return entry.page;
+            }
+            PageEntry* set = find_set( addr);
+            if ( set == NULL || set[get_page(addr)].host_page == NULL)
+            {
+                return NULL;
+            }
+            entry.page_num = addr >> offset_bits;
+            entry.page = &set[get_page(addr)];
+            return entry.page;
+        }
+
+        /* Returns host page containing addr or NULL if it is not allocated. */
+        inline uint8* find_page( uint64 addr) const
+        {
+            if ( flat != NULL)
+            {
+                return get_flat_epoch( addr) != 0 ? flat + ( addr & flat_mask & ~offset_mask)
+                                                  : NULL;
+            }
+            PageEntry* page = find_entry( addr);
+            return page != NULL ? page->host_page : NULL;
+        }
+
+        /*
+         * The same for a store: the page is marked as written in the current
+         * epoch. NULL is returned also for a page shared with a snapshot.
+         */
+        inline uint8* find_page_to_write( uint64 addr)
+        {
+            if ( flat != NULL)
+            {
+                uint32& page_epoch = get_flat_epoch( addr);
+                if ( page_epoch == 0)
+                {
+                    return NULL;
+                }
+                page_epoch = epoch;
+                return flat + ( addr & flat_mask & ~offset_mask);
+            }
+            PageEntry* page = find_entry( addr);
+            if ( page == NULL || page->owner != id)
+            {
+                return NULL;
+            }
+            page->epoch = epoch;
+            return page->host_page;
+        }
+
+        /* Checks if the access does not cross page boundary. */
+        inline bool is_inside_page( uint64 addr, unsigned short num_of_bytes) const
+        {
+            return get_offset( addr) + num_of_bytes <= get_page_size();
+        }
         
         inline size_t get_set( uint64 addr) const
         {
@@ -55,7 +232,11 @@ class FuncMemory
         
         inline uint8* get_host_addr( uint64 addr) const
         {
-            return &memory[get_set(addr)][get_page(addr)][get_offset(addr)];
+            if ( flat != NULL)
+            {
+                return flat + ( addr & flat_mask);
+            }
+            return &find_set(addr)[get_page(addr)].host_page[get_offset(addr)];
         }
 
         inline uint8 read_byte( uint64 addr) const
@@ -68,19 +249,149 @@ class FuncMemory
            *get_host_addr(addr) = value;
         }
         
+        void init( Backend backend);
+        void map_elf( const char* executable_file_name);
         void alloc( uint64 addr);
-        bool check( uint64 addr) const;
+        PageEntry& alloc_entry( uint64 addr);
+        void get_dirty_pages( const NodeEntry* node, uint64 node_bits, uint64 shift,
+                              uint64 set, uint32 since_epoch,
+                              std::vector<uint64>& addrs) const;
+
+        // a snapshot shares everything with its parent, see snapshot()
+        FuncMemory( const FuncMemory& parent);
+        FuncMemory& operator=( const FuncMemory&);
 
     public:
         FuncMemory ( const char* executable_file_name,
                      uint64 addr_size = 32,
                      uint64 page_num_size = 10,
-                     uint64 offset_size = 12);
+                     uint64 offset_size = 12,
+                     Backend backend = BACKEND_TABLES);
+        /* Creates empty memory, pages are added by write or map_page. */
+        FuncMemory ( uint64 start_PC,
+                     uint64 addr_size,
+                     uint64 page_num_size,
+                     uint64 offset_size,
+                     Backend backend = BACKEND_TABLES);
         virtual ~FuncMemory();
         uint64 read( uint64 addr, unsigned short num_of_bytes = 4) const;
         void write( uint64 value, uint64 addr, unsigned short num_of_bytes = 4);
+
+        /* Copies size bytes to addr, each page is allocated and filled once. */
+        void write_block( uint64 addr, const uint8* data, uint64 size);
+        /*
+         * Loads ELF sections or segments to their addresses. Whole pages
+         * share the mapped file, the memory keeps a reference to it.
+         */
+        void load_image( const std::vector<ElfSection>& sections, uint64 start_PC);
         inline uint64 startPC() const { return startPC_addr; }
+        bool check( uint64 addr) const; // is addr allocated
+
+        /* Returns host address of the byte at addr or NULL if it is not allocated. */
+        uint8* find_host_addr( uint64 addr) const
+        {
+            uint8* page = find_page( addr);
+            return page != NULL ? page + get_offset( addr) : NULL;
+        }
+        /*
+         * The same for stores bypassing write(): the page is marked as
+         * written in the current epoch. NULL is returned also for a page
+         * shared with a snapshot or a file, write() copies it first.
+         */
+        uint8* find_host_addr_to_write( uint64 addr)
+        {
+            uint8* page = find_page_to_write( addr);
+            return page != NULL ? page + get_offset( addr) : NULL;
+        }
+        /*
+         * Host addresses kept by a simulator are right while this number
+         * is the same. It changes when a new epoch starts, so stores have
+         * to be marked again, when a snapshot is taken, so pages become
+         * shared, and when a page is copied on write or mapped anew.
+         * Memory access hooks do not see accesses through
+         * such addresses, so hooked simulators use read() and write().
+         */
+        uint32 get_host_generation() const { return host_generation; }
+        /* Prints nonzero bytes of all pages, one per line. */
         std::string dump( string indent = "") const;
+
+        uint64 get_addr_bits() const { return addr_bits; }
+        uint64 get_page_bits() const { return page_bits; }
+        uint64 get_offset_bits() const { return offset_bits; }
+        uint64 get_page_size() const { return offset_mask + 1; } // as allocated by alloc
+
+        /* Appends start addresses of all allocated pages to addrs. */
+        void get_pages( std::vector<uint64>& addrs) const;
+
+        /*
+         * Stores mark their pages with the current epoch. Loading happens in
+         * FIRST_EPOCH, new_epoch() starts the next one and returns its number.
+         * Stores through pointers returned by find_host_addr_to_write are
+         * marked once, such pointers are dropped when the epoch changes.
+         */
+        static const uint32 FIRST_EPOCH = 1;
+        uint32 get_epoch() const { return epoch; }
+        uint32 new_epoch()
+        {
+            ++host_generation;
+            return ++epoch;
+        }
+
+        /* Appends start addresses of pages written since the epoch to addrs. */
+        void get_dirty_pages( uint32 since_epoch, std::vector<uint64>& addrs) const;
+
+        /*
+         * Streams nonzero bytes of pages written since the epoch as dump() does.
+         * Zero words are skipped without looking at their bytes.
+         */
+        void dump( std::ostream& out, uint32 since_epoch) const;
+
+        /*
+         * Prints bytes which differ from those of other memory, one per line.
+         * Only pages written since the epoch in either memory are compared,
+         * a missing page is read as zeroes. Returns number of such bytes.
+         */
+        uint64 diff( std::ostream& out, const FuncMemory& other,
+                     uint32 since_epoch = FIRST_EPOCH) const;
+
+        /*
+         * Passes ownership of the mmap'ed region to the memory, it is
+         * unmapped with the last memory sharing it. Pages inside it are
+         * added by map_page.
+         */
+        void add_image( uint8* data, size_t size);
+
+        /* Uses host_page as the page containing addr instead of allocating it. */
+        void map_page( uint64 addr, uint8* host_page);
+
+        /*
+         * Uses read-only host_page as the page containing addr, the page is
+         * copied on the first write to it. The host page should be kept
+         * by the caller or by an image referenced by the memory.
+         */
+        void map_shared_page( uint64 addr, const uint8* host_page);
+
+        /*
+         * Memory footprint: pages allocated for the guest and set tables,
+         * pages copied from those shared with snapshots and size of
+         * host memory reserved by this memory (without shared one).
+         */
+        uint64 get_pages_num() const { return pages_num; }
+        uint64 get_sets_num() const { return sets_num; }
+        uint64 get_copied_pages_num() const { return copied_pages_num; }
+        uint64 get_host_size() const
+        {
+            return storage->page_arena.get_reserved_size() +
+                   storage->set_arena.get_reserved_size();
+        }
+
+        /*
+         * Returns a memory with the same content which shares all pages
+         * with this one. A page is copied by the memory which stores to it
+         * first. Memories may be deleted in any order and used by different
+         * threads. Only the tables backend can be snapshotted.
+         */
+        FuncMemory* snapshot();
 };
 
 #endif // #ifndef FUNC_MEMORY__FUNC_MEMORY_H
@@ -0,0 +1,84 @@
+/*
+ * load_bench.cpp - benchmark of loading program images to FuncMemory
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#include <cstdlib>
+#include <ctime>
+
+#include <iostream>
+#include <vector>
+
+#include <func_memory.h>
+
+static const uint64 data_addr = 0x10000000;
+static const uint64 data_size = 16 << 20; // initialized ".data"
+static const uint64 bss_addr = 0x20000000;
+static const uint64 bss_size = 64 << 20;  // zeroed ".bss"
+
+static double seconds_since( std::clock_t start)
+{
+    return double( std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main( int argc, char* argv[])
+{
+    if ( argc > 2)
+    {
+        std::cerr << "ERROR: Wrong number of arguments! Optional argument "
+                  << "is an ELF file to load." << std::endl;
+        std::exit( EXIT_FAILURE);
+    }
+
+    std::vector<uint8> data( data_size);
+    for ( size_t i = 0; i < data.size(); ++i)
+        data[ i] = i * 7 + ( i >> 12);
+    std::vector<uint8> bss( bss_size, 0);
+
+    std::clock_t start = std::clock();
+    {
+        FuncMemory mem( 0x400000, 32, 10, 12);
+        mem.write_block( data_addr, &data[ 0], data.size());
+        mem.write_block( bss_addr, &bss[ 0], bss.size());
+    }
+    double block_seconds = seconds_since( start);
+
+    // the way images were loaded before write_block, byte by byte
+    start = std::clock();
+    {
+        FuncMemory mem( 0x400000, 32, 10, 12);
+        for ( size_t i = 0; i < data.size(); ++i)
+            mem.write( data[ i], data_addr + i, 1);
+        for ( size_t i = 0; i < bss.size(); ++i)
+            mem.write( bss[ i], bss_addr + i, 1);
+    }
+    double byte_seconds = seconds_since( start);
+
+    double megabytes = double( data_size + bss_size) / ( 1 << 20);
+    std::cout << "loaded " << megabytes << " MB of .data and .bss: "
+              << block_seconds << " s by blocks, "
+              << byte_seconds << " s by bytes" << std::endl;
+
+    if ( argc == 2)
+    {
+        start = std::clock();
+        FuncMemory mem( argv[ 1]);
+        std::cout << "loaded " << argv[ 1] << " in " << seconds_since( start)
+                  << " s: " << mem.get_pages_num() << " pages, "
+                  << mem.get_sets_num() << " set tables, "
+                  << mem.get_host_size() / 1024 << " KB of host memory" << std::endl;
+
+        // segments copied to the memory, instead of sharing the file
+        start = std::clock();
+        std::vector<ElfSection> segments;
+        uint64 start_PC = ElfSection::getLoadSegments( argv[ 1], segments);
+        FuncMemory copy( start_PC, 32, 10, 12);
+        for ( size_t i = 0; i < segments.size(); ++i)
+            copy.write_block( segments[ i].start_addr, segments[ i].content,
+                              segments[ i].file_size);
+        std::cout << "copied " << argv[ 1] << " in " << seconds_since( start)
+                  << " s: " << copy.get_host_size() / 1024 << " KB of host memory, "
+                  << mem.diff( std::cerr, copy) << " bytes differ" << std::endl;
+    }
+    return 0;
+}
@@ -24,7 +24,8 @@ int main (int argc, char* argv[])
         FuncMemory func_mem( file_name, 32, 10, 12);
         
         // print content of the memory
-        cout << func_mem.dump() << endl;
+        func_mem.dump( cout, FuncMemory::FIRST_EPOCH);
+        cout << endl;
  
     } else if ( argc - 1 > num_of_args)
     {
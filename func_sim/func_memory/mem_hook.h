@@ -0,0 +1,94 @@
+/*
+ * mem_hook.h - policies observing memory accesses of simulators
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef MEM_HOOK_H
+#define MEM_HOOK_H
+
+#include <vector>
+
+#include <types.h>
+
+enum MemAccessType
+{
+    MEM_FETCH, // instruction fetch
+    MEM_READ,  // data load
+    MEM_WRITE  // data store
+};
+
+struct MemAccess
+{
+    uint64 PC;
+    uint64 addr;
+    uint32 size;
+    MemAccessType type;
+};
+
+/*
+ * Simulators take a hook as a template parameter and call
+ *     hook.access( PC, addr, size, type)
+ * for each access and hook.flush() at the end of run. Calls to the
+ * default hook are empty inline functions, so there is nothing left of
+ * them on the hot path.
+ */
+struct NoMemHook
+{
+    static const bool ENABLED = false;
+
+    void access( uint64 /* PC */, uint64 /* addr */, uint32 /* size */,
+                 MemAccessType /* type */) { }
+    void flush() { }
+};
+
+/* Receives accesses in blocks from BatchedMemHook. */
+class MemAccessConsumer
+{
+    public:
+        virtual ~MemAccessConsumer() { }
+        virtual void consume( const MemAccess* accesses, size_t num) = 0;
+};
+
+/*
+ * Collects accesses to a buffer and passes thousands of them at once,
+ * so the virtual call is made once per batch.
+ */
+class BatchedMemHook
+{
+        static const size_t BATCH_SIZE = 4096;
+
+        MemAccessConsumer* consumer;
+        std::vector<MemAccess> batch;
+        size_t used;
+
+    public:
+        static const bool ENABLED = true;
+
+        explicit BatchedMemHook( MemAccessConsumer* consumer)
+            : consumer( consumer)
+            , batch( BATCH_SIZE)
+            , used( 0)
+        { }
+
+        ~BatchedMemHook() { flush(); }
+
+        void access( uint64 PC, uint64 addr, uint32 size, MemAccessType type)
+        {
+            MemAccess& access = batch[ used];
+            access.PC = PC;
+            access.addr = addr;
+            access.size = size;
+            access.type = type;
+            if ( ++used == BATCH_SIZE)
+                flush();
+        }
+
+        void flush()
+        {
+            if ( used != 0)
+                consumer->consume( &batch[ 0], used);
+            used = 0;
+        }
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * page_image.cpp - pages of guest memory saved to a file and mapped back
+ * Copyright 2015 MIPT-MIPS
+ */
+
+// Generic C
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// MIPT-MIPS modules
+#include <page_image.h>
+
+static const uint64 ALIGNMENT = 1 << 12;
+
+void PageImage::init( Layout& layout, const FuncMemory& mem, uint64 table_offset,
+                      std::vector<uint64>& pages)
+{
+    mem.get_pages( pages);
+    layout.addr_bits = mem.get_addr_bits();
+    layout.page_bits = mem.get_page_bits();
+    layout.offset_bits = mem.get_offset_bits();
+    layout.pages_num = pages.size();
+    uint64 table_end = table_offset + pages.size() * sizeof( uint64);
+    layout.data_offset = ( table_end + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+void PageImage::write( std::ostream& file, const Layout& layout, uint64 table_offset,
+                       const FuncMemory& mem, const std::vector<uint64>& pages)
+{
+    if ( !pages.empty())
+        file.write( reinterpret_cast<const char*>( &pages[ 0]), pages.size() * sizeof( uint64));
+    std::vector<char> padding( layout.data_offset - table_offset - pages.size() * sizeof( uint64));
+    file.write( padding.data(), padding.size());
+
+    for ( size_t i = 0; i < pages.size(); ++i)
+        file.write( reinterpret_cast<const char*>( mem.find_host_addr( pages[ i])),
+                    mem.get_page_size());
+}
+
+uint8* PageImage::map_file( const std::string& file_name, size_t min_size, size_t& size)
+{
+    int fd = open( file_name.c_str(), O_RDONLY);
+    if ( fd < 0)
+        return NULL;
+
+    struct stat st;
+    if ( fstat( fd, &st) != 0 || size_t( st.st_size) < min_size || st.st_size == 0)
+    {
+        close( fd);
+        return NULL;
+    }
+
+    size = st.st_size;
+    void* ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close( fd);
+    return ( ptr == MAP_FAILED) ? NULL : static_cast<uint8*>( ptr);
+}
+
+bool PageImage::check( const Layout& layout, uint64 table_offset, uint64 end)
+{
+    return layout.offset_bits < 64 && layout.data_offset % ALIGNMENT == 0 &&
+           table_offset <= layout.data_offset && layout.data_offset <= end &&
+           layout.pages_num <= ( layout.data_offset - table_offset) / sizeof( uint64) &&
+           layout.pages_num == ( end - layout.data_offset) >> layout.offset_bits &&
+           get_end( layout) == end;
+}
+
+FuncMemory* PageImage::map_pages( uint8* data, size_t size, const Layout& layout,
+                                  uint64 table_offset, uint64 start_PC,
+                                  FuncMemory::Backend backend)
+{
+    FuncMemory* mem = new FuncMemory( start_PC, layout.addr_bits, layout.page_bits,
+                                      layout.offset_bits, backend);
+    mem->add_image( data, size);
+    const uint64* pages = reinterpret_cast<const uint64*>( data + table_offset);
+    uint64 page_size = 1ull << layout.offset_bits;
+    for ( size_t i = 0; i < layout.pages_num; ++i)
+        mem->map_page( pages[ i], data + layout.data_offset + i * page_size);
+    return mem;
+}
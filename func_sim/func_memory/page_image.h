@@ -0,0 +1,74 @@
+/*
+ * page_image.h - pages of guest memory saved to a file and mapped back
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef PAGE_IMAGE_H
+#define PAGE_IMAGE_H
+
+// Generic C++
+#include <ostream>
+#include <string>
+#include <vector>
+
+// MIPT-MIPS modules
+#include <types.h>
+#include <func_memory.h>
+
+/*
+ * Pages as checkpoints and sim images keep them: the file header is
+ * followed by an array of page addresses and then by page data aligned
+ * to the host page size, so the pages are mmap'ed straight from the file.
+ */
+class PageImage
+{
+    public:
+        /* Part of the file header describing the pages. */
+        struct Layout
+        {
+            // memory geometry, see FuncMemory constructor
+            uint64 addr_bits;
+            uint64 page_bits;
+            uint64 offset_bits;
+
+            uint64 pages_num;
+            uint64 data_offset; // the first page, it is aligned
+        };
+
+        /*
+         * Fills the layout of all pages of mem with the address array at
+         * table_offset, their addresses are appended to pages.
+         */
+        static void init( Layout& layout, const FuncMemory& mem, uint64 table_offset,
+                          std::vector<uint64>& pages);
+
+        /* Returns the offset of the end of page data. */
+        static uint64 get_end( const Layout& layout)
+        {
+            return layout.data_offset + ( layout.pages_num << layout.offset_bits);
+        }
+
+        /* Writes the address array, the padding and the page data after the header. */
+        static void write( std::ostream& file, const Layout& layout, uint64 table_offset,
+                           const FuncMemory& mem, const std::vector<uint64>& pages);
+
+        /*
+         * Maps the file privately: pages are read on touch, stores are not
+         * written back. Returns NULL if the file cannot be mapped or is
+         * shorter than min_size.
+         */
+        static uint8* map_file( const std::string& file_name, size_t min_size, size_t& size);
+
+        /* Checks that the layout read from the file is whole and ends at end. */
+        static bool check( const Layout& layout, uint64 table_offset, uint64 end);
+
+        /*
+         * Creates memory with the pages mapped from the file mapped by
+         * map_file(), the mapping is released with the memory.
+         */
+        static FuncMemory* map_pages( uint8* data, size_t size, const Layout& layout,
+                                      uint64 table_offset, uint64 start_PC,
+                                      FuncMemory::Backend backend);
+};
+
+#endif // PAGE_IMAGE_H
@@ -2,6 +2,9 @@
 #include <cassert>
 #include <cstdlib>
 
+// generic C++
+#include <sstream>
+
 // Google Test library
 #include <gtest/gtest.h>
 
@@ -113,6 +116,298 @@ TEST( Func_memory, Write_Read_Not_Initialized_Mem_Test)
     ASSERT_EQ( func_mem.read( write_addr + 2, sizeof( uint16)), right_ret);
 }
 
+TEST( Func_memory, Write_Read_All_Sizes_Test)
+{
+    FuncMemory func_mem( valid_elf_file);
+
+    // accesses inside a page (aligned and not) and crossing page boundary
+    uint64 page_end = 0x10001000;
+    uint64 addrs[] = { page_end - 0x100, page_end - 0xff, page_end - 5,
+                       page_end - 3, page_end - 1 };
+    unsigned short sizes[] = { 1, 2, 3, 4, 8 };
+    uint64 value = 0x8877665544332211ull;
+
+    for ( size_t i = 0; i < sizeof( addrs) / sizeof( addrs[ 0]); ++i)
+        for ( size_t j = 0; j < sizeof( sizes) / sizeof( sizes[ 0]); ++j)
+        {
+            uint64 mask = ( sizes[ j] == 8) ? ~0ull : ( 1ull << ( 8 * sizes[ j])) - 1;
+            func_mem.write( 0, addrs[ i], 8);
+            func_mem.write( value, addrs[ i], sizes[ j]);
+            ASSERT_EQ( func_mem.read( addrs[ i], sizes[ j]), value & mask);
+            ASSERT_EQ( func_mem.read( addrs[ i], 8), value & mask);
+            for ( unsigned short k = 0; k < sizes[ j]; ++k)
+                ASSERT_EQ( func_mem.read( addrs[ i] + k, 1), ( value >> ( 8 * k)) & 0xff);
+        }
+
+    // the page is still found after other pages have been accessed
+    func_mem.write( 0x12345678, 0x7ffffff0);
+    for ( uint64 addr = 0x20000000; addr < 0x20000000 + 0x1000 * 256; addr += 0x1000)
+        func_mem.write( addr, addr);
+    ASSERT_EQ( func_mem.read( 0x7ffffff0), 0x12345678ull);
+    ASSERT_EQ( func_mem.read( 0x20000000 + 0x1000 * 64), 0x20000000ull + 0x1000 * 64);
+}
+
+TEST( Func_memory, Write_Block_Test)
+{
+    for ( int backend = FuncMemory::BACKEND_TABLES; backend <= FuncMemory::BACKEND_FLAT; ++backend)
+    {
+        FuncMemory func_mem( valid_elf_file, 32, 10, 12, ( FuncMemory::Backend)backend);
+
+        // starts in the middle of a page and spans three pages
+        std::vector<uint8> block( 0x2100);
+        for ( size_t i = 0; i < block.size(); ++i)
+            block[ i] = i ^ ( i >> 8);
+        uint64 block_addr = 0x10000f80;
+        func_mem.write_block( block_addr, &block[ 0], block.size());
+
+        ASSERT_FALSE( func_mem.check( block_addr - 0x1000));
+        ASSERT_TRUE( func_mem.check( block_addr + block.size() - 1));
+        for ( size_t i = 0; i < block.size(); ++i)
+            ASSERT_EQ( func_mem.read( block_addr + i, 1), block[ i]);
+
+        // nothing is written out of the block
+        ASSERT_EQ( func_mem.read( block_addr - 1, 1), 0ull);
+        ASSERT_EQ( func_mem.read( block_addr + block.size(), 1), 0ull);
+    }
+}
+
+TEST( Func_memory, Flat_Backend_Test)
+{
+    FuncMemory tables( valid_elf_file);
+    FuncMemory flat( valid_elf_file, 32, 10, 12, FuncMemory::BACKEND_FLAT);
+    ASSERT_EQ( flat.startPC(), tables.startPC());
+    ASSERT_EQ( flat.read( 0x4100c0), tables.read( 0x4100c0));
+
+    flat.write( 0x1122334455667788ull, 0xfffffffc, 4);
+    flat.write( 0x1122334455667788ull, 0x10000ffe, 8); // crosses a page
+    tables.write( 0x1122334455667788ull, 0xfffffffc, 4);
+    tables.write( 0x1122334455667788ull, 0x10000ffe, 8);
+    ASSERT_EQ( flat.read( 0x10000ffe, 8), 0x1122334455667788ull);
+    ASSERT_EQ( flat.read( 0xfffffffc), 0x55667788ull);
+
+    ASSERT_TRUE( flat.check( 0x10001000));
+    ASSERT_FALSE( flat.check( 0x10002000));
+    ASSERT_EQ( flat.find_host_addr( 0x10002000), ( uint8*)NULL);
+    ASSERT_EXIT( flat.read( 0x300000),
+                 ::testing::KilledBySignal( SIGABRT), ".*");
+
+    std::vector<uint64> flat_pages;
+    std::vector<uint64> table_pages;
+    flat.get_pages( flat_pages);
+    tables.get_pages( table_pages);
+    ASSERT_EQ( flat_pages, table_pages);
+    ASSERT_EQ( flat.dump(), tables.dump());
+
+    // only 32-bit address space is reserved as a whole
+    ASSERT_EXIT( FuncMemory func_mem( valid_elf_file, 48, 18, 12, FuncMemory::BACKEND_FLAT),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+    ASSERT_NO_THROW( FuncMemory func_mem( valid_elf_file, 32, 10, 12,
+                                          FuncMemory::BACKEND_FLAT_THP));
+}
+
+TEST( Func_memory, Page_Stats_Test)
+{
+    for ( int backend = FuncMemory::BACKEND_TABLES; backend <= FuncMemory::BACKEND_FLAT; ++backend)
+    {
+        FuncMemory func_mem( 0x400000, 32, 10, 12, ( FuncMemory::Backend)backend);
+        ASSERT_EQ( func_mem.get_pages_num(), 0u);
+        ASSERT_EQ( func_mem.get_sets_num(), 0u);
+
+        func_mem.write( 1, 0x10000000);
+        func_mem.write( 2, 0x10000004); // the same page
+        func_mem.write( 3, 0x10001ffe); // crosses to the third page
+        func_mem.write( 4, 0x20000000); // another set
+        ASSERT_EQ( func_mem.get_pages_num(), 4u);
+        ASSERT_EQ( func_mem.read( 0x10000004), 2u);
+        ASSERT_EQ( func_mem.read( 0x10001000), 0u); // new pages are zeroed
+
+        std::vector<uint64> pages;
+        func_mem.get_pages( pages);
+        ASSERT_EQ( pages.size(), func_mem.get_pages_num());
+        if ( backend == FuncMemory::BACKEND_TABLES)
+        {
+            ASSERT_EQ( func_mem.get_sets_num(), 2u);
+            ASSERT_GE( func_mem.get_host_size(), 4u * func_mem.get_page_size());
+        }
+    }
+}
+
+TEST( Func_memory, Dirty_Pages_Test)
+{
+    for ( int backend = FuncMemory::BACKEND_TABLES; backend <= FuncMemory::BACKEND_FLAT; ++backend)
+    {
+        FuncMemory func_mem( valid_elf_file, 32, 10, 12, ( FuncMemory::Backend)backend);
+        FuncMemory other( valid_elf_file, 32, 10, 12, ( FuncMemory::Backend)backend);
+        std::vector<uint64> pages;
+        func_mem.get_dirty_pages( FuncMemory::FIRST_EPOCH, pages);
+        ASSERT_FALSE( pages.empty()); // loaded ones
+
+        uint32 epoch = func_mem.new_epoch();
+        ASSERT_EQ( other.new_epoch(), epoch);
+        pages.clear();
+        func_mem.get_dirty_pages( epoch, pages);
+        ASSERT_TRUE( pages.empty());
+
+        func_mem.write( 0xab, 0x4100c1, 1); // loaded page
+        func_mem.write( 0x1234, 0x10000ffe, 4); // new pages
+        func_mem.get_dirty_pages( epoch, pages);
+        ASSERT_EQ( pages.size(), 3u);
+        ASSERT_EQ( pages[ 0], 0x410000u);
+        ASSERT_EQ( pages[ 1], 0x10000000u);
+        ASSERT_EQ( pages[ 2], 0x10001000u);
+
+        std::ostringstream oss;
+        func_mem.dump( oss, func_mem.new_epoch());
+        ASSERT_EQ( oss.str(), "");
+        func_mem.dump( oss, epoch);
+        ASSERT_NE( oss.str().find( "addr 0x4100c1: data 0xab\n"), std::string::npos);
+        ASSERT_NE( oss.str().find( "addr 0x10000ffe: data 0x34\n"), std::string::npos);
+        ASSERT_NE( oss.str().find( "addr 0x10000fff: data 0x12\n"), std::string::npos);
+
+        // the dump of all pages is streamed in the same way
+        std::ostringstream full;
+        func_mem.dump( full, FuncMemory::FIRST_EPOCH);
+        ASSERT_EQ( full.str(), func_mem.dump());
+
+        std::ostringstream diff;
+        ASSERT_EQ( func_mem.diff( diff, other, epoch), 3u);
+        ASSERT_NE( diff.str().find( "addr 0x10000fff: data 0x12 != 0x00\n"), std::string::npos);
+        other.write( 0x1234, 0x10000ffe, 4);
+        ASSERT_EQ( func_mem.diff( diff, other, epoch), 1u);
+        ASSERT_EQ( func_mem.diff( diff, other), 1u);
+    }
+}
+
+TEST( Func_memory, Snapshot_Test)
+{
+    FuncMemory* func_mem = new FuncMemory( valid_elf_file);
+    func_mem->write( 1, 0x10000000);
+
+    FuncMemory* snapshot = func_mem->snapshot();
+    ASSERT_EQ( snapshot->startPC(), func_mem->startPC());
+    ASSERT_EQ( snapshot->read( 0x10000000), 1u);
+    ASSERT_EQ( snapshot->dump(), func_mem->dump());
+    ASSERT_EQ( snapshot->get_pages_num(), func_mem->get_pages_num());
+
+    // stores are not visible in the other memory
+    func_mem->write( 2, 0x10000000);
+    snapshot->write( 3, 0x4100c0); // ELF page
+    snapshot->write( 4, 0x20000000); // new page
+    ASSERT_EQ( func_mem->read( 0x10000000), 2u);
+    ASSERT_EQ( snapshot->read( 0x10000000), 1u);
+    ASSERT_EQ( func_mem->read( 0x4100c0), 0x03020100u);
+    ASSERT_EQ( snapshot->read( 0x4100c0), 3u);
+    ASSERT_FALSE( func_mem->check( 0x20000000));
+    ASSERT_EQ( func_mem->get_copied_pages_num(), 1u);
+    ASSERT_EQ( snapshot->get_copied_pages_num(), 1u);
+
+    // the copy is written in place
+    func_mem->write( 5, 0x10000004);
+    ASSERT_EQ( func_mem->get_copied_pages_num(), 1u);
+
+    // pages stay alive while any snapshot uses them
+    FuncMemory* second = snapshot->snapshot();
+    delete func_mem;
+    delete snapshot;
+    ASSERT_EQ( second->read( 0x10000000), 1u);
+    ASSERT_EQ( second->read( 0x4100c0), 3u);
+    ASSERT_EQ( second->read( 0x20000000), 4u);
+    second->write( 6, 0x10000000);
+    ASSERT_EQ( second->read( 0x10000000), 6u);
+    delete second;
+
+    FuncMemory flat( valid_elf_file, 32, 10, 12, FuncMemory::BACKEND_FLAT);
+    ASSERT_EXIT( flat.snapshot(), ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+}
+
+TEST( Func_memory, Shared_Page_Test)
+{
+    // whole pages of ELF files are shared this way
+    std::vector<uint8> page( 1 << 12, 0);
+    page[ 0] = 7;
+    FuncMemory func_mem( 0x400000, 32, 10, 12);
+    func_mem.map_shared_page( 0x10000000, &page[ 0]);
+    ASSERT_EQ( func_mem.find_host_addr( 0x10000000), &page[ 0]);
+    ASSERT_EQ( func_mem.read( 0x10000000, 1), 7u);
+
+    // the first write copies the page, the shared one stays intact
+    func_mem.write( 9, 0x10000000, 1);
+    ASSERT_EQ( func_mem.read( 0x10000000, 1), 9u);
+    ASSERT_EQ( page[ 0], 7);
+    ASSERT_EQ( func_mem.get_copied_pages_num(), 1u);
+}
+
+TEST( Func_memory, Host_Addr_To_Write_Test)
+{
+    std::vector<uint8> page( 1 << 12, 0);
+    FuncMemory func_mem( 0x400000, 32, 10, 12);
+    func_mem.map_shared_page( 0x10000000, &page[ 0]);
+    func_mem.write( 1, 0x20000000);
+
+    // the shared page is copied by write() first, which drops its host address
+    ASSERT_EQ( func_mem.find_host_addr_to_write( 0x10000000), ( uint8*)NULL);
+    ASSERT_EQ( func_mem.find_host_addr_to_write( 0x30000000), ( uint8*)NULL);
+    uint32 generation = func_mem.get_host_generation();
+    func_mem.write( 2, 0x10000000);
+    ASSERT_NE( func_mem.get_host_generation(), generation);
+    generation = func_mem.get_host_generation();
+    func_mem.write( 3, 0x10000008);
+    ASSERT_EQ( func_mem.get_host_generation(), generation);
+    ASSERT_EQ( func_mem.find_host_addr_to_write( 0x10000004),
+               func_mem.find_host_addr( 0x10000004));
+
+    // the page is written in the epoch the address is taken
+    uint32 epoch = func_mem.new_epoch();
+    ASSERT_NE( func_mem.get_host_generation(), generation);
+    *func_mem.find_host_addr_to_write( 0x20000000) = 3;
+    std::vector<uint64> pages;
+    func_mem.get_dirty_pages( epoch, pages);
+    ASSERT_EQ( pages, std::vector<uint64>( 1, 0x20000000));
+    ASSERT_EQ( func_mem.read( 0x20000000), 3u);
+
+    // pages are shared after a snapshot
+    generation = func_mem.get_host_generation();
+    FuncMemory* snapshot = func_mem.snapshot();
+    ASSERT_NE( func_mem.get_host_generation(), generation);
+    ASSERT_EQ( func_mem.find_host_addr_to_write( 0x20000000), ( uint8*)NULL);
+    ASSERT_EQ( snapshot->find_host_addr_to_write( 0x20000000), ( uint8*)NULL);
+    delete snapshot;
+}
+
+TEST( Func_memory, Sparse_64_Bit_Test)
+{
+    FuncMemory func_mem( 0x120000000ull, 64, 10, 12);
+    ASSERT_EQ( func_mem.startPC(), 0x120000000ull);
+
+    uint64 addrs[] = { 0x10ull, 0x120000000ull, 0x7fff00000ffcull,
+                       0x123456789abc0ull, 0xfffffffffffffff8ull };
+    for ( size_t i = 0; i < sizeof( addrs) / sizeof( addrs[ 0]); ++i)
+        func_mem.write( addrs[ i] ^ 0x5555, addrs[ i], 8);
+    for ( size_t i = 0; i < sizeof( addrs) / sizeof( addrs[ 0]); ++i)
+        ASSERT_EQ( func_mem.read( addrs[ i], 8), addrs[ i] ^ 0x5555);
+
+    // high bits select different pages
+    ASSERT_FALSE( func_mem.check( 0x20000000ull));
+    ASSERT_FALSE( func_mem.check( 0x100000010ull));
+    ASSERT_EQ( func_mem.read( 0x7fff00001000ull, 4), ( 0x7fff00000ffcull ^ 0x5555) >> 32);
+
+    std::vector<uint64> pages;
+    func_mem.get_pages( pages);
+    uint64 expected[] = { 0x0ull, 0x120000000ull, 0x7fff00000000ull, 0x7fff00001000ull,
+                          0x123456789a000ull, 0xfffffffffffff000ull };
+    ASSERT_EQ( pages, std::vector<uint64>( expected, expected + sizeof( expected) / sizeof( expected[ 0])));
+    ASSERT_EQ( func_mem.get_pages_num(), pages.size());
+
+    // the tables take space proportional to the touched pages
+    ASSERT_LT( func_mem.get_host_size(), 16u << 20);
+
+    FuncMemory* snapshot = func_mem.snapshot();
+    snapshot->write( 1, 0xfffffffffffffff8ull, 8);
+    ASSERT_EQ( func_mem.read( 0xfffffffffffffff8ull, 8), 0xfffffffffffffff8ull ^ 0x5555);
+    ASSERT_EQ( snapshot->read( 0xfffffffffffffff8ull, 8), 1u);
+    delete snapshot;
+}
+
 int main( int argc, char* argv[])
 {
     ::testing::InitGoogleTest( &argc, argv);
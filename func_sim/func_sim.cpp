@@ -1,44 +1,223 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
 
 #include <func_sim.h>
 
-MIPS::MIPS()
+template <typename Hook>
+BasicMIPS<Hook>::BasicMIPS(const Hook& hook) : hook(hook)
 {
     rf = new RF();
+    bb = NULL;
+    threaded = NULL;
+    trace = NULL;
+    commit_trace = NULL;
+    print_memory_stats = false;
+    print_profile = false;
+    profile = NULL;
 }
 
-void MIPS::run(const std::string& tr, uint32 instrs_to_run)
+template <typename Hook>
+void BasicMIPS<Hook>::step()
 {
-    mem = new FuncMemory(tr.c_str());
+    // fetch and decode
+    FuncInstr instr = decode();
+    if (profile != NULL)
+        profile->count_instr(PC);
+
+    // read sources
+    read_src(instr);
+
+    // execute
+    instr.execute();
+
+    // load/store
+    load_store(instr);
+
+    // writeback
+    wb(instr);
+
+    // PC update
+    PC = instr.get_new_PC();
+
+    // dump
+    if (trace != NULL)
+        *trace << instr << '\n';
+    if (commit_trace != NULL) {
+        CommitRecord record = { instr.get_PC(), instr.get_bytes(),
+                                uint8(instr.get_dst_num()), instr.get_v_dst(),
+                                instr.is_load() || instr.is_store(), instr.get_mem_addr() };
+        commit_trace->write(record);
+    }
+}
+
+template <typename Hook>
+void BasicMIPS<Hook>::check_engine(Engine engine) const
+{
+    if (Hook::ENABLED && engine != ENGINE_INTERP) {
+        std::cerr << "ERROR: Memory accesses are observed only by the interpreter" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (print_profile && engine != ENGINE_INTERP) {
+        std::cerr << "ERROR: Instructions are profiled only by the interpreter" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+template <typename Hook>
+void BasicMIPS<Hook>::start_engine(Engine engine, const SimImage::Text& text)
+{
+    icache = new InstrCache();
+    for (uint32 i = 0; i < text.size; ++i)
+        if (text.is_valid[i])
+            icache->insert(text.instrs[i], text.addr + i * sizeof(uint32));
+    bb = (engine == ENGINE_BB || engine == ENGINE_JIT)
+         ? new BBEngine(rf, mem, icache, trace, commit_trace, engine == ENGINE_JIT)
+         : NULL;
+    threaded = (engine == ENGINE_THREADED)
+               ? new ThreadedEngine(rf, mem, icache, trace, commit_trace)
+               : NULL;
+}
+
+template <typename Hook>
+void BasicMIPS<Hook>::stop_engine()
+{
+    hook.flush();
+    delete threaded;
+    delete bb;
+    delete icache;
+    threaded = NULL;
+    bb = NULL;
+    icache = NULL;
+}
+
+template <typename Hook>
+void BasicMIPS<Hook>::execute(uint32 instrs_to_run)
+{
+    uint32 executed = 0;
+    while (executed < instrs_to_run) {
+        // blocks stop at code which cannot be translated,
+        // the interpreter executes it and reports errors
+        if (bb != NULL)
+            executed += bb->run(PC, instrs_to_run - executed);
+        else if (threaded != NULL)
+            executed += threaded->run(PC, instrs_to_run - executed);
+        if (executed < instrs_to_run) {
+            step();
+            ++executed;
+        }
+    }
+}
+
+template <typename Hook>
+void BasicMIPS<Hook>::run(const std::string& tr, uint32 instrs_to_run, Trace& trace, Engine engine,
+                          CommitTraceWriter* commit_trace, FuncMemory::Backend backend)
+{
+    check_engine(engine);
+
+    this->trace = trace.is_enabled() ? &trace : NULL;
+    this->commit_trace = commit_trace;
+    SimImage::Text text = { 0, 0, NULL, NULL };
+    if (Checkpoint::is_checkpoint(tr)) {
+        Checkpoint::State state;
+        mem = Checkpoint::load(tr, state, backend);
+        for (size_t i = 0; i < REG_NUM_MAX; ++i)
+            rf->write((RegNum)i, state.reg[i]);
+    } else if (!image_cache.empty()) {
+        mem = SimImage::load(tr, image_cache, text, backend);
+    } else {
+        mem = new FuncMemory(tr.c_str(), 32, 10, 12, backend);
+    }
+    start_engine(engine, text);
     PC = mem->startPC();
-    for (uint32 i = 0; i < instrs_to_run; ++i) {
-        // fetch
-        uint32 instr_bytes = fetch();
-   
-        // decode
-        FuncInstr instr(instr_bytes, PC);
-
-        // read sources
-        read_src(instr);
-
-        // execute
-        instr.execute();
-
-        // load/store
-        load_store(instr);
-
-        // writeback
-        wb(instr);
-        
-        // PC update
-        PC = instr.get_new_PC();
-        
-        // dump
-        std::cout << instr << std::endl;
+    if (print_profile)
+        profile = new Profile(Checkpoint::elf_file_name(tr));
+    if (commit_trace != NULL)
+        commit_trace->write_header(tr, PC);
+
+    uint32 executed = 0;
+    std::vector<uint32>::const_iterator checkpoint = checkpoints.begin();
+    while (true) {
+        for (; checkpoint != checkpoints.end() && *checkpoint == executed; ++checkpoint)
+            save_checkpoint(tr, executed);
+        if (executed == instrs_to_run)
+            break;
+
+        // engines stop at the next checkpoint
+        uint32 limit = instrs_to_run;
+        if (checkpoint != checkpoints.end() && *checkpoint < limit)
+            limit = *checkpoint;
+        execute(limit - executed);
+        executed = limit;
     }
+
+    stop_engine();
+    if (print_memory_stats)
+        std::cerr << "guest memory: " << mem->get_pages_num() << " pages of "
+                  << mem->get_page_size() << " bytes, " << mem->get_sets_num()
+                  << " set tables, " << mem->get_host_size() / 1024
+                  << " KB of host memory reserved" << std::endl;
+    if (profile != NULL)
+        profile->print(std::cerr);
+
+    delete profile;
+    profile = NULL;
+
     delete mem;
+    mem = NULL;
 }
 
-MIPS::~MIPS() {
+template <typename Hook>
+void BasicMIPS<Hook>::run(FuncMemory* mem, Checkpoint::State& state, uint32 instrs_to_run,
+                          Engine engine)
+{
+    check_engine(engine);
+
+    trace = NULL;
+    commit_trace = NULL;
+    this->mem = mem;
+    for (size_t i = 0; i < REG_NUM_MAX; ++i)
+        rf->write((RegNum)i, state.reg[i]);
+    PC = state.PC;
+
+    SimImage::Text text = { 0, 0, NULL, NULL };
+    start_engine(engine, text);
+    execute(instrs_to_run);
+    stop_engine();
+
+    state.PC = PC;
+    for (size_t i = 0; i < REG_NUM_MAX; ++i)
+        state.reg[i] = rf->read((RegNum)i);
+    state.instrs_executed += instrs_to_run;
+    this->mem = NULL;
+}
+
+template <typename Hook>
+void BasicMIPS<Hook>::add_checkpoint(uint32 count)
+{
+    checkpoints.insert(std::upper_bound(checkpoints.begin(), checkpoints.end(), count), count);
+}
+
+template <typename Hook>
+void BasicMIPS<Hook>::save_checkpoint(const std::string& tr, uint32 instrs_executed) const
+{
+    Checkpoint::State state;
+    state.PC = PC;
+    for (size_t i = 0; i < REG_NUM_MAX; ++i)
+        state.reg[i] = rf->read((RegNum)i);
+    state.instrs_executed = instrs_executed;
+
+    std::ostringstream file_name;
+    file_name << tr << '.' << instrs_executed << ".ckpt";
+    Checkpoint::save(file_name.str(), *mem, state);
+}
+
+template <typename Hook>
+BasicMIPS<Hook>::~BasicMIPS() {
     delete rf;
 }
+
+// simulators available to the other modules
+template class BasicMIPS<NoMemHook>;
+template class BasicMIPS<BatchedMemHook>;
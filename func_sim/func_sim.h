@@ -10,26 +10,84 @@
 #include <func_instr.h>
 #include <func_memory.h>
 #include <rf.h>
+#include <instr_cache.h>
+#include <bb_engine.h>
+#include <threaded_engine.h>
+#include <trace.h>
+#include <commit_trace.h>
+#include <checkpoint.h>
+#include <mem_hook.h>
+#include <profile.h>
+#include <sim_image.h>
 
-class MIPS
+#include <vector>
+
+struct MIPSEngine
+{
+    enum Engine
+    {
+        ENGINE_INTERP, // decode and execute instruction by instruction
+        ENGINE_BB,     // execute translated basic blocks
+        ENGINE_THREADED, // direct-threaded execution of predecoded code
+        ENGINE_JIT     // basic blocks, hot ones are compiled to host code
+    };
+};
+
+/*
+ * Hook is a policy observing memory accesses, see mem_hook.h.
+ * Only the interpreter calls it, other engines access memory directly.
+ */
+template <typename Hook>
+class BasicMIPS : public MIPSEngine
 {
     private:
+        Hook hook;
         RF* rf;
         uint32 PC;
         FuncMemory* mem;
+        InstrCache* icache;
+        BBEngine* bb;
+        ThreadedEngine* threaded;
+        Trace* trace; // NULL if no trace is printed
+        CommitTraceWriter* commit_trace; // NULL if no commit trace is written
+        std::vector<uint32> checkpoints; // sorted instruction counts
+        bool print_memory_stats;
+        bool print_profile;
+        Profile* profile; // NULL if instructions are not profiled
+        std::string image_cache; // empty if ELF files are loaded directly
+
+        void save_checkpoint(const std::string& tr, uint32 instrs_executed) const;
 
         uint32 fetch() const { return mem->read(PC); }
+
+        // fetch and decode, each static instruction is decoded once
+        const FuncInstr& decode() {
+            hook.access(PC, PC, sizeof(uint32), MEM_FETCH);
+            const FuncInstr* instr = icache->find(PC);
+            if (instr == NULL)
+                instr = icache->insert(FuncInstr(fetch(), PC), PC);
+            return *instr;
+        }
+
         void read_src(FuncInstr& instr) const {
             rf->read_src1(instr); 
             rf->read_src2(instr); 
 	    }
 
-        void load(FuncInstr& instr) const {
+        void load(FuncInstr& instr) {
+            hook.access(PC, instr.get_mem_addr(), instr.get_mem_size(), MEM_READ);
             instr.set_v_dst(mem->read(instr.get_mem_addr(), instr.get_mem_size()));
         }
 
         void store(const FuncInstr& instr) {
+            hook.access(PC, instr.get_mem_addr(), instr.get_mem_size(), MEM_WRITE);
             mem->write(instr.get_v_src2(), instr.get_mem_addr(), instr.get_mem_size());
+            if (icache->invalidate(instr.get_mem_addr(), instr.get_mem_size())) {
+                if (bb != NULL)
+                    bb->flush();
+                if (threaded != NULL)
+                    threaded->invalidate(instr.get_mem_addr(), instr.get_mem_size());
+            }
         }
 
 	    void load_store(FuncInstr& instr) {
@@ -42,11 +100,50 @@ class MIPS
         void wb(const FuncInstr& instr) {
             rf->write_dst(instr);
         }
+
+        // interprets one instruction
+        void step();
+
+        void check_engine(Engine engine) const;
+        // creates the engine working on mem, rf and PC
+        void start_engine(Engine engine, const SimImage::Text& text);
+        void stop_engine();
+        // executes instructions by the engine, the interpreter takes the rest
+        void execute(uint32 instrs_to_run);
    public:
-        MIPS();
-        void run(const std::string& tr, uint32 instrs_to_run);
-        ~MIPS();
+        explicit BasicMIPS(const Hook& hook = Hook());
+        /*
+         * Makes run() save checkpoint "<mips_exe>.<count>.ckpt" after
+         * count instructions. Checkpoints are loaded by run() like ELF files.
+         */
+        void add_checkpoint(uint32 count);
+        /* Makes run() print the guest memory footprint to stderr at the end. */
+        void enable_memory_stats() { print_memory_stats = true; }
+        /*
+         * Makes run() print a flat profile of executed instructions by
+         * functions to stderr at the end, only the interpreter counts them.
+         */
+        void enable_profile() { print_profile = true; }
+        /*
+         * Makes run() load ELF files by sim images kept in the directory,
+         * code of ".text" comes predecoded by them, see sim_image.h.
+         */
+        void set_image_cache(const std::string& dir) { image_cache = dir; }
+        void run(const std::string& tr, uint32 instrs_to_run,
+                 Trace& trace, Engine engine = ENGINE_INTERP,
+                 CommitTraceWriter* commit_trace = NULL,
+                 FuncMemory::Backend backend = FuncMemory::BACKEND_TABLES);
+        /*
+         * Executes instrs_to_run instructions of a program loaded by
+         * another simulator, e.g. to fast-forward it. Registers and PC
+         * are taken from state and updated, mem is kept by the caller.
+         */
+        void run(FuncMemory* mem, Checkpoint::State& state, uint32 instrs_to_run,
+                 Engine engine = ENGINE_JIT);
+        ~BasicMIPS();
 };
+
+typedef BasicMIPS<NoMemHook> MIPS;
             
 #endif
  
@@ -0,0 +1,164 @@
+/*
+ * instr_cache.h - cache of decoded mips instructions indexed by PC
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef INSTR_CACHE_H
+#define INSTR_CACHE_H
+
+#include <map>
+
+#include <func_instr.h>
+#include <func_memory.h>
+
+/*
+ * Each static instruction is decoded only once: decoded FuncInstr objects
+ * are stored in pages of the text segment. Stores into a cached page
+ * invalidate the overwritten instructions (self-modifying code).
+ */
+class InstrCache
+{
+        static const uint32 PAGE_BITS = 12;
+        static const uint32 PAGE_INSTRS = ( 1 << PAGE_BITS) / sizeof( uint32);
+
+        struct Page
+        {
+            FuncInstr instr[ PAGE_INSTRS];
+            bool is_valid[ PAGE_INSTRS];
+
+            Page()
+            {
+                for ( size_t i = 0; i < PAGE_INSTRS; ++i)
+                    is_valid[ i] = false;
+            }
+        };
+
+        typedef std::map<uint32, Page*> PageMap;
+        PageMap pages;
+
+        // the last accessed page, loops usually stay inside one page
+        uint32 last_page_num;
+        Page* last_page;
+
+        // unaligned PCs are not cached, the instruction is kept here
+        FuncInstr uncached;
+
+        static uint32 get_page_num( uint32 addr) { return addr >> PAGE_BITS; }
+        static uint32 get_index( uint32 addr)
+        {
+            return ( addr & ( ( 1 << PAGE_BITS) - 1)) / sizeof( uint32);
+        }
+
+        Page* find_page( uint32 page_num)
+        {
+            if ( last_page != NULL && last_page_num == page_num)
+                return last_page;
+
+            PageMap::iterator it = pages.find( page_num);
+            if ( it == pages.end())
+                return NULL;
+
+            last_page_num = page_num;
+            last_page = it->second;
+            return last_page;
+        }
+
+        bool invalidate_word( uint32 addr)
+        {
+            Page* page = find_page( get_page_num( addr));
+            if ( page == NULL || !page->is_valid[ get_index( addr)])
+                return false;
+
+            page->is_valid[ get_index( addr)] = false;
+            return true;
+        }
+
+    public:
+        InstrCache() : last_page_num( 0), last_page( NULL) { }
+
+        ~InstrCache()
+        {
+            for ( PageMap::iterator it = pages.begin(); it != pages.end(); ++it)
+                delete it->second;
+        }
+
+        /* Checks if the page containing addr may hold decoded instructions. */
+        bool has_page( uint32 addr) { return find_page( get_page_num( addr)) != NULL; }
+
+        /* Returns decoded instruction placed at PC or NULL if it is not cached. */
+        const FuncInstr* find( uint32 PC)
+        {
+            if ( PC % sizeof( uint32) != 0)
+                return NULL;
+
+            Page* page = find_page( get_page_num( PC));
+            if ( page == NULL || !page->is_valid[ get_index( PC)])
+                return NULL;
+
+            return &page->instr[ get_index( PC)];
+        }
+
+        /* Stores decoded instruction and returns the cached copy. */
+        const FuncInstr* insert( const FuncInstr& instr, uint32 PC)
+        {
+            if ( PC % sizeof( uint32) != 0)
+            {
+                uncached = instr;
+                return &uncached;
+            }
+
+            Page* page = find_page( get_page_num( PC));
+            if ( page == NULL)
+            {
+                page = new Page;
+                pages[ get_page_num( PC)] = page;
+                last_page_num = get_page_num( PC);
+                last_page = page;
+            }
+
+            size_t index = get_index( PC);
+            page->instr[ index] = instr;
+            page->is_valid[ index] = true;
+            return &page->instr[ index];
+        }
+
+        /*
+         * Returns cached or newly decoded instruction placed at PC, or NULL if
+         * the interpreter would fail on it (unaligned or unallocated PC,
+         * unknown instruction). Used by engines which leave such code
+         * to the interpreter.
+         */
+        const FuncInstr* decode( const FuncMemory& mem, uint32 PC)
+        {
+            const FuncInstr* instr = find( PC);
+            if ( instr != NULL)
+                return instr;
+
+            if ( PC % sizeof( uint32) != 0 ||
+                 !mem.check( PC) || !mem.check( PC + sizeof( uint32) - 1))
+                return NULL;
+
+            uint32 bytes = mem.read( PC);
+            if ( !FuncInstr::is_known( bytes))
+                return NULL;
+
+            return insert( FuncInstr( bytes, PC), PC);
+        }
+
+        /*
+         * Drops instructions overwritten by a store of num_of_bytes at addr.
+         * Returns true if any cached instruction was dropped.
+         */
+        bool invalidate( uint32 addr, uint32 num_of_bytes)
+        {
+            if ( pages.empty())
+                return false;
+
+            bool hit = invalidate_word( addr);
+            if ( get_index( addr) != get_index( addr + num_of_bytes - 1))
+                hit |= invalidate_word( addr + num_of_bytes - 1);
+            return hit;
+        }
+};
+
+#endif
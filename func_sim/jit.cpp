@@ -0,0 +1,443 @@
+/*
+ * jit.cpp - translation of mips basic blocks into x86-64 host code
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include <iostream>
+
+#include <sys/mman.h>
+
+#include <jit.h>
+
+#if !defined(__x86_64__)
+#error "JIT supports only x86-64 hosts"
+#endif
+
+// x86-64 registers
+enum HostReg
+{
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    EBX = 3,
+    ESI = 6,
+    EDI = 7
+};
+
+static uint32 reg_offset( uint8 reg) { return offsetof( BBState, reg) + reg * sizeof( uint32); }
+static const uint32 HI_OFFSET = offsetof( BBState, hi);
+static const uint32 LO_OFFSET = offsetof( BBState, lo);
+static const uint32 NEXT_PC_OFFSET = offsetof( BBState, next_PC);
+static const uint32 CODE_MODIFIED_OFFSET = offsetof( BBState, code_modified);
+static const uint32 MEM_ADDR_OFFSET = offsetof( BBState, mem_addr);
+static const uint32 READ_TLB_OFFSET = offsetof( BBState, read_tlb);
+static const uint32 WRITE_TLB_OFFSET = offsetof( BBState, write_tlb);
+
+/* Puts the page containing host_addr of addr to TLB unless it is NULL. */
+static void fill_tlb( BBTLBEntry* tlb, const FuncMemory* mem, uint32 addr, uint8* host_addr)
+{
+    // TLB page must lie inside one page of the memory
+    if ( host_addr == NULL || mem->get_page_size() <= JIT::TLB_PAGE_MASK)
+        return;
+
+    BBTLBEntry& entry = tlb[ ( addr >> JIT::TLB_PAGE_BITS) % BBState::TLB_SIZE];
+    entry.page_num = addr >> JIT::TLB_PAGE_BITS;
+    entry.host_page = host_addr - ( addr & JIT::TLB_PAGE_MASK);
+}
+
+/* Functions called from the host code on TLB misses. */
+static uint32 jit_load( BBState* state, uint32 addr, uint32 size)
+{
+    uint32 value = state->mem->read( addr, size);
+    fill_tlb( state->read_tlb, state->mem, addr, state->mem->find_host_addr( addr));
+    return value;
+}
+
+static void jit_store( BBState* state, uint32 addr, uint32 value, uint32 size)
+{
+    state->mem->write( value, addr, size);
+    JIT::sync_tlb( *state); // the write may have copied a shared page
+
+    if ( state->icache->invalidate( addr, size))
+        state->code_modified = true;
+    else if ( !state->icache->has_page( addr))
+        fill_tlb( state->write_tlb, state->mem, addr, state->mem->find_host_addr_to_write( addr));
+}
+
+static void jit_dump( BBState* state, const BBOp* op)
+{
+    BBEngine::dump( *state, *op);
+}
+
+JIT::JIT( bool is_silent) : used( 0), is_silent( is_silent)
+{
+    void* ptr = mmap( NULL, BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( ptr == MAP_FAILED)
+    {
+        cerr << "ERROR: Could not allocate executable memory for JIT" << endl;
+        exit( EXIT_FAILURE);
+    }
+    buffer = static_cast<uint8*>( ptr);
+}
+
+JIT::~JIT()
+{
+    munmap( buffer, BUFFER_SIZE);
+}
+
+void JIT::flush_tlb( BBState& state)
+{
+    for ( size_t i = 0; i < BBState::TLB_SIZE; ++i)
+        state.read_tlb[ i].page_num = state.write_tlb[ i].page_num = ~0u;
+    state.mem_generation = state.mem->get_host_generation();
+}
+
+void JIT::sync_tlb( BBState& state)
+{
+    if ( state.mem_generation != state.mem->get_host_generation())
+        flush_tlb( state);
+}
+
+void JIT::emit32( uint32 value)
+{
+    for ( size_t i = 0; i < sizeof( value); ++i)
+        emit8( value >> ( 8 * i));
+}
+
+void JIT::emit64( uint64 value)
+{
+    for ( size_t i = 0; i < sizeof( value); ++i)
+        emit8( value >> ( 8 * i));
+}
+
+// mov host_reg, [rbx + offset]
+void JIT::load( uint8 host_reg, uint32 offset)
+{
+    emit8( 0x8B); emit8( 0x83 | ( host_reg << 3)); emit32( offset);
+}
+
+// mov [rbx + offset], host_reg
+void JIT::store( uint32 offset, uint8 host_reg)
+{
+    emit8( 0x89); emit8( 0x83 | ( host_reg << 3)); emit32( offset);
+}
+
+// mov dword [rbx + offset], value
+void JIT::store_imm( uint32 offset, uint32 value)
+{
+    emit8( 0xC7); emit8( 0x83); emit32( offset); emit32( value);
+}
+
+// mov rdi, rbx; mov rax, func; call rax
+void JIT::call( const void* func)
+{
+    emit8( 0x48); emit8( 0x89); emit8( 0xDF);
+    emit8( 0x48); emit8( 0xB8); emit64( reinterpret_cast<uint64>( func));
+    emit8( 0xFF); emit8( 0xD0);
+}
+
+// jcc/jmp rel32, returns position of the offset to be patched
+size_t JIT::jump( uint8 opcode)
+{
+    if ( opcode != 0xE9)
+        emit8( 0x0F);
+    emit8( opcode);
+    emit32( 0);
+    return code.size() - sizeof( uint32);
+}
+
+// makes the jump target the current position
+void JIT::patch( size_t pos)
+{
+    uint32 rel = code.size() - ( pos + sizeof( uint32));
+    memcpy( &code[ pos], &rel, sizeof( rel));
+}
+
+/*
+ * Looks up address %esi in TLB, on hit %rdx is the host page and %eax is
+ * the offset in it. Positions of two jumps to the miss path are returned.
+ */
+void JIT::tlb_lookup( uint32 tlb_offset, uint32 size, size_t miss[ 2])
+{
+    // accesses crossing the page boundary are misses
+    emit8( 0x89); emit8( 0xF0);                     // mov eax, esi
+    emit8( 0x25); emit32( TLB_PAGE_MASK);           // and eax, mask
+    emit8( 0x3D); emit32( TLB_PAGE_MASK + 1 - size); // cmp eax, limit
+    miss[ 0] = jump( 0x87);                         // ja miss
+
+    emit8( 0x89); emit8( 0xF0);                     // mov eax, esi
+    emit8( 0xC1); emit8( 0xE8); emit8( TLB_PAGE_BITS); // shr eax, bits
+    emit8( 0x89); emit8( 0xC1);                     // mov ecx, eax
+    emit8( 0x81); emit8( 0xE1); emit32( BBState::TLB_SIZE - 1); // and ecx, size - 1
+    emit8( 0xC1); emit8( 0xE1); emit8( 4);          // shl ecx, log2( sizeof( BBTLBEntry))
+    emit8( 0x3B); emit8( 0x84); emit8( 0x0B);       // cmp eax, [rbx + rcx + tag]
+    emit32( tlb_offset + offsetof( BBTLBEntry, page_num));
+    miss[ 1] = jump( 0x85);                         // jne miss
+    emit8( 0x48); emit8( 0x8B); emit8( 0x94); emit8( 0x0B); // mov rdx, [rbx + rcx + page]
+    emit32( tlb_offset + offsetof( BBTLBEntry, host_page));
+    emit8( 0x89); emit8( 0xF0);                     // mov eax, esi
+    emit8( 0x25); emit32( TLB_PAGE_MASK);           // and eax, mask
+}
+
+void JIT::compile_load( const BBOp& op)
+{
+    load( ESI, reg_offset( op.src1));
+    emit8( 0x81); emit8( 0xC6); emit32( op.imm); // add esi, imm
+    if ( !is_silent)
+        store( MEM_ADDR_OFFSET, ESI);            // the address is traced
+    size_t miss[ 2];
+    tlb_lookup( READ_TLB_OFFSET, op.mem_size, miss);
+    switch ( op.mem_size)
+    {
+        case 1:  emit8( 0x0F); emit8( 0xB6); break; // movzx eax, byte
+        case 2:  emit8( 0x0F); emit8( 0xB7); break; // movzx eax, word
+        default: emit8( 0x8B); break;               // mov eax, dword
+    }
+    emit8( 0x04); emit8( 0x02);                  // [rdx + rax]
+    size_t done = jump( 0xE9);
+
+    patch( miss[ 0]);
+    patch( miss[ 1]);
+    emit8( 0xBA); emit32( op.mem_size);          // mov edx, size
+    call( reinterpret_cast<const void*>( jit_load));
+
+    patch( done);
+    store( reg_offset( op.dst), EAX);
+}
+
+void JIT::compile_store( const BBOp& op)
+{
+    load( ESI, reg_offset( op.src1));
+    emit8( 0x81); emit8( 0xC6); emit32( op.imm); // add esi, imm
+    if ( !is_silent)
+        store( MEM_ADDR_OFFSET, ESI);            // the address is traced
+    load( ECX, reg_offset( op.src2));
+    emit8( 0x89); emit8( 0xCF);                  // mov edi, ecx
+    size_t miss[ 2];
+    tlb_lookup( WRITE_TLB_OFFSET, op.mem_size, miss);
+    switch ( op.mem_size)
+    {
+        case 1:  emit8( 0x40); emit8( 0x88); break; // mov byte, dil
+        case 2:  emit8( 0x66); emit8( 0x89); break; // mov word, di
+        default: emit8( 0x89); break;               // mov dword, edi
+    }
+    emit8( 0x3C); emit8( 0x02);                  // [rdx + rax]
+    size_t done = jump( 0xE9);
+
+    patch( miss[ 0]);
+    patch( miss[ 1]);
+    emit8( 0x89); emit8( 0xFA);                  // mov edx, edi
+    emit8( 0xB9); emit32( op.mem_size);          // mov ecx, size
+    call( reinterpret_cast<const void*>( jit_store));
+
+    patch( done);
+}
+
+/*
+ * Emits host code of one operation. The semantics is the same as of
+ * BBEngine handlers, %eax and %ecx are operands and result.
+ */
+bool JIT::compile_op( const BBOp& op, uint32 index)
+{
+    switch ( op.kind)
+    {
+        case OP_ADD:
+        case OP_ADDU:
+        case OP_SUB:
+        case OP_SUBU:
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+        case OP_NOR:
+            load( EAX, reg_offset( op.src1));
+            load( ECX, reg_offset( op.src2));
+            switch ( op.kind)
+            {
+                case OP_ADD:
+                case OP_ADDU: emit8( 0x01); break;
+                case OP_SUB:
+                case OP_SUBU: emit8( 0x29); break;
+                case OP_AND:  emit8( 0x21); break;
+                case OP_XOR:  emit8( 0x31); break;
+                default:      emit8( 0x09); break; // or, nor
+            }
+            emit8( 0xC8); // op eax, ecx
+            if ( op.kind == OP_NOR)
+            {
+                emit8( 0xF7); emit8( 0xD0); // not eax
+            }
+            store( reg_offset( op.dst), EAX);
+            break;
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_ANDI:
+        case OP_ORI:
+        case OP_XORI:
+            load( EAX, reg_offset( op.src1));
+            switch ( op.kind)
+            {
+                case OP_ADDI:  emit8( 0x05); emit32( (int32)(int16)op.imm); break;
+                case OP_ADDIU: emit8( 0x05); emit32( op.imm); break;
+                case OP_ANDI:  emit8( 0x25); emit32( op.imm); break;
+                case OP_ORI:   emit8( 0x0D); emit32( op.imm); break;
+                default:       emit8( 0x35); emit32( op.imm); break;
+            }
+            store( reg_offset( op.dst), EAX);
+            break;
+        case OP_MULT:
+            // the product is 32-bit as in FuncInstr
+            load( EAX, reg_offset( op.src1));
+            load( ECX, reg_offset( op.src2));
+            emit8( 0x0F); emit8( 0xAF); emit8( 0xC1); // imul eax, ecx
+            store( LO_OFFSET, EAX);
+            store_imm( HI_OFFSET, 0);
+            break;
+        case OP_DIV:
+            load( EAX, reg_offset( op.src2));
+            load( ECX, reg_offset( op.src1));
+            emit8( 0x31); emit8( 0xD2); // xor edx, edx
+            emit8( 0xF7); emit8( 0xF1); // div ecx
+            store( LO_OFFSET, EAX);
+            store( HI_OFFSET, EDX);
+            break;
+        case OP_MFHI:
+            load( EAX, HI_OFFSET);
+            store( reg_offset( op.dst), EAX);
+            break;
+        case OP_MFLO:
+            load( EAX, LO_OFFSET);
+            store( reg_offset( op.dst), EAX);
+            break;
+        case OP_MTHI:
+            load( EAX, reg_offset( op.src2));
+            store( HI_OFFSET, EAX);
+            break;
+        case OP_MTLO:
+            load( EAX, reg_offset( op.src2));
+            store( LO_OFFSET, EAX);
+            break;
+        case OP_SLL:
+        case OP_SRL:
+            load( EAX, reg_offset( op.src1));
+            emit8( 0xC1); emit8( op.kind == OP_SLL ? 0xE0 : 0xE8); emit8( op.imm);
+            store( reg_offset( op.dst), EAX);
+            break;
+        case OP_SLLV:
+        case OP_SRLV:
+            load( EAX, reg_offset( op.src1));
+            load( ECX, reg_offset( op.src2));
+            emit8( 0xD3); emit8( op.kind == OP_SLLV ? 0xE0 : 0xE8); // shift eax, cl
+            store( reg_offset( op.dst), EAX);
+            break;
+        case OP_LUI:
+            store_imm( reg_offset( op.dst), op.imm << 0x10);
+            break;
+        case OP_SLT:
+        case OP_SLTI:
+            load( EAX, reg_offset( op.src2));
+            if ( op.kind == OP_SLT)
+            {
+                load( ECX, reg_offset( op.src1));
+                emit8( 0x39); emit8( 0xC8); // cmp eax, ecx
+            }
+            else
+            {
+                emit8( 0x3D); emit32( op.imm); // cmp eax, imm
+            }
+            emit8( 0x0F); emit8( 0x92); emit8( 0xC0); // setb al
+            emit8( 0x0F); emit8( 0xB6); emit8( 0xC0); // movzx eax, al
+            store( reg_offset( op.dst), EAX);
+            break;
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BGTZ:
+            load( EAX, reg_offset( op.src1));
+            load( ECX, reg_offset( op.src2));
+            emit8( 0x39); emit8( 0xC8); // cmp eax, ecx
+            // skip setting of the target if the branch is not taken
+            emit8( op.kind == OP_BEQ ? 0x75 : op.kind == OP_BNE ? 0x74 : 0x77);
+            emit8( 10);
+            store_imm( NEXT_PC_OFFSET, op.imm);
+            break;
+        case OP_BLEZ:
+            load( EAX, reg_offset( op.src1));
+            emit8( 0x85); emit8( 0xC0); // test eax, eax
+            emit8( 0x75); emit8( 10);   // jne
+            store_imm( NEXT_PC_OFFSET, op.imm);
+            break;
+        case OP_J:
+            store_imm( NEXT_PC_OFFSET, op.imm);
+            break;
+        case OP_JAL:
+            store_imm( reg_offset( op.dst), op.instr->get_new_PC());
+            store_imm( NEXT_PC_OFFSET, op.imm);
+            break;
+        case OP_JR:
+            load( EAX, reg_offset( op.src1));
+            store( NEXT_PC_OFFSET, EAX);
+            break;
+        case OP_JALR:
+            load( EAX, reg_offset( op.src2));
+            store_imm( reg_offset( op.dst), op.instr->get_new_PC());
+            store( NEXT_PC_OFFSET, EAX);
+            break;
+        case OP_NOP:
+            break;
+        case OP_LOAD:
+            compile_load( op);
+            break;
+        case OP_STORE:
+            compile_store( op);
+            break;
+        default:
+            return false;
+    }
+
+    if ( !is_silent)
+    {
+        emit8( 0x48); emit8( 0xBE); emit64( reinterpret_cast<uint64>( &op)); // mov rsi, op
+        call( reinterpret_cast<const void*>( jit_dump));
+    }
+
+    if ( op.kind == OP_STORE)
+    {
+        // leave the block if the store has modified the code
+        emit8( 0x80); emit8( 0xBB); emit32( CODE_MODIFIED_OFFSET); emit8( 0); // cmp byte
+        emit8( 0x74); emit8( 7);                  // je
+        emit8( 0xB8); emit32( index + 1);         // mov eax, executed
+        emit8( 0x5B);                             // pop rbx
+        emit8( 0xC3);                             // ret
+    }
+    return true;
+}
+
+BBCode JIT::compile( const BBBlock& block)
+{
+    code.clear();
+    emit8( 0x53);                             // push rbx
+    emit8( 0x48); emit8( 0x89); emit8( 0xFB); // mov rbx, rdi
+
+    for ( size_t i = 0; i < block.ops.size(); ++i)
+        if ( !compile_op( block.ops[ i], i))
+            return NULL;
+
+    emit8( 0xB8); emit32( block.ops.size()); // mov eax, executed
+    emit8( 0x5B);                             // pop rbx
+    emit8( 0xC3);                             // ret
+
+    if ( used + code.size() > BUFFER_SIZE)
+    {
+        used = BUFFER_SIZE;
+        return NULL;
+    }
+
+    uint8* entry = buffer + used;
+    memcpy( entry, &code[ 0], code.size());
+    used += ( code.size() + 15) & ~size_t( 15);
+    return reinterpret_cast<BBCode>( entry);
+}
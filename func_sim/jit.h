@@ -0,0 +1,76 @@
+/*
+ * jit.h - translation of mips basic blocks into x86-64 host code
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <vector>
+
+#include <bb_engine.h>
+
+/*
+ * Host code is emitted into an executable mmap'd buffer. Compiled blocks
+ * keep the architectural state in BBState (pointed by %rbx). Loads and
+ * stores access host pages found in the software TLB of BBState, misses
+ * are handled by calls to FuncMemory which refill the TLB. Write TLB gets
+ * only pages marked as written in the current epoch and owned by the
+ * memory, so stores hitting it need no FuncMemory::write. When the
+ * buffer is full, all blocks should be dropped and the buffer reset.
+ */
+class JIT
+{
+        static const size_t BUFFER_SIZE = 16 << 20;
+
+        uint8* buffer;
+        size_t used;
+        bool is_silent; // trace calls are not emitted
+
+        std::vector<uint8> code; // block being compiled
+
+        bool compile_op( const BBOp& op, uint32 index);
+
+        // x86-64 encoding helpers
+        void emit8( uint8 byte) { code.push_back( byte); }
+        void emit32( uint32 value);
+        void emit64( uint64 value);
+        void load( uint8 host_reg, uint32 offset);
+        void store( uint32 offset, uint8 host_reg);
+        void store_imm( uint32 offset, uint32 value);
+        void call( const void* func);
+        size_t jump( uint8 opcode);
+        void patch( size_t pos);
+        void tlb_lookup( uint32 tlb_offset, uint32 size, size_t miss[ 2]);
+        void compile_load( const BBOp& op);
+        void compile_store( const BBOp& op);
+
+    public:
+        // TLB pages have the same size as InstrCache ones
+        static const uint32 TLB_PAGE_BITS = 12;
+        static const uint32 TLB_PAGE_MASK = ( 1 << TLB_PAGE_BITS) - 1;
+
+        JIT( bool is_silent);
+        ~JIT();
+
+        /* Returns NULL if the block has unsupported operations or no space left. */
+        BBCode compile( const BBBlock& block);
+
+        bool is_full() const { return used == BUFFER_SIZE; }
+
+        /* Drops all compiled code. */
+        void reset() { used = 0; }
+
+        /* Empties TLB, should be done when new pages of code are decoded. */
+        static void flush_tlb( BBState& state);
+
+        /*
+         * Empties TLB if its host pages may be stale: a new epoch or
+         * a snapshot of the memory is started or a page is copied on write,
+         * see FuncMemory::get_host_generation. Must follow every store
+         * made through FuncMemory::write while compiled code may run.
+         */
+        static void sync_tlb( BBState& state);
+};
+
+#endif
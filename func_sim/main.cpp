@@ -5,22 +5,182 @@
  */
 
 #include <iostream>
+#include <fstream>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
 
 #include <func_sim.h>
 
+static void usage(const char* name)
+{
+    std::cout << "Usage: " << name << " [-s] [-o trace_file] [-a] [-e interp|bb|threaded|jit]"
+              << " [-b commit_trace_file] [-c count]..."
+              << " [-m tables|flat|flat-thp] [-v] [-d data_addr_file] [-p] [-i cache_dir]"
+              << " mips_exe instrs_to_run" << std::endl
+              << "    -s    silent mode, no trace is printed" << std::endl
+              << "    -o    write trace to the file instead of stdout" << std::endl
+              << "    -a    write trace asynchronously by a separate thread" << std::endl
+              << "    -e    execution engine: instruction interpreter (default)," << std::endl
+              << "          translated basic blocks, direct-threaded code" << std::endl
+              << "          or basic blocks with hot ones compiled to x86-64 code" << std::endl
+              << "    -b    write binary trace of committed instructions to the file," << std::endl
+              << "          traces are compared by func_sim/trace/trace_diff" << std::endl
+              << "    -c    save checkpoint mips_exe.<count>.ckpt after count instructions," << std::endl
+              << "          checkpoints are run by func_sim and perf_sim instead of mips_exe" << std::endl
+              << "    -m    guest memory: pages allocated on demand (default)," << std::endl
+              << "          flat 4 GiB mapping or flat one with transparent huge pages" << std::endl
+              << "    -v    print guest memory footprint to stderr after the run" << std::endl
+              << "    -d    write addresses of loads and stores to the file for" << std::endl
+              << "          perf_sim/mem/miss_rate_sim, only with the interpreter" << std::endl
+              << "    -p    print flat profile of instructions by functions of mips_exe" << std::endl
+              << "          to stderr after the run, only with the interpreter" << std::endl
+              << "    -i    load mips_exe by its preprocessed image in the directory," << std::endl
+              << "          the image is made there by the first run" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+// data addresses in hex, one per line
+class DataAddrWriter : public MemAccessConsumer
+{
+        std::ofstream out;
+    public:
+        explicit DataAddrWriter(const std::string& file_name) : out(file_name.c_str()) {
+            if (!out.is_open()) {
+                std::cerr << "ERROR: Could not open file " << file_name << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            out << std::hex;
+        }
+
+        void consume(const MemAccess* accesses, size_t num) {
+            for (size_t i = 0; i < num; ++i)
+                if (accesses[i].type != MEM_FETCH)
+                    out << accesses[i].addr << '\n';
+        }
+};
+
+struct Options
+{
+    std::vector<uint32> checkpoints;
+    bool memory_stats;
+    bool profile;
+    std::string image_cache;
+    MIPS::Engine engine;
+    FuncMemory::Backend backend;
+};
+
+template <typename Hook>
+static void simulate(BasicMIPS<Hook>& mips, const Options& options, const char* tr,
+                     uint32 instrs_to_run, Trace& trace, CommitTraceWriter* commit_trace)
+{
+    for (size_t i = 0; i < options.checkpoints.size(); ++i)
+        mips.add_checkpoint(options.checkpoints[i]);
+    if (options.memory_stats)
+        mips.enable_memory_stats();
+    if (options.profile)
+        mips.enable_profile();
+    if (!options.image_cache.empty())
+        mips.set_image_cache(options.image_cache);
+    mips.run(std::string(tr), instrs_to_run, trace, options.engine, commit_trace, options.backend);
+}
+
 int main( int argc, char* argv[])
 {
-    if ( argc != 3)
+    Options options;
+    options.memory_stats = false;
+    options.profile = false;
+    options.engine = MIPS::ENGINE_INTERP;
+    options.backend = FuncMemory::BACKEND_TABLES;
+    Trace::Output output = Trace::OUTPUT_STDOUT;
+    std::string trace_file;
+    std::string commit_trace_file;
+    std::string data_addr_file;
+    bool is_async = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "so:ae:b:c:m:vd:pi:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'e':
+                if (!strcmp(optarg, "interp"))
+                    options.engine = MIPS::ENGINE_INTERP;
+                else if (!strcmp(optarg, "bb"))
+                    options.engine = MIPS::ENGINE_BB;
+                else if (!strcmp(optarg, "threaded"))
+                    options.engine = MIPS::ENGINE_THREADED;
+                else if (!strcmp(optarg, "jit"))
+                    options.engine = MIPS::ENGINE_JIT;
+                else
+                    usage(argv[0]);
+                break;
+            case 's':
+                output = Trace::OUTPUT_NONE;
+                break;
+            case 'o':
+                output = Trace::OUTPUT_FILE;
+                trace_file = optarg;
+                break;
+            case 'a':
+                is_async = true;
+                break;
+            case 'b':
+                commit_trace_file = optarg;
+                break;
+            case 'c':
+                options.checkpoints.push_back(atoi(optarg));
+                break;
+            case 'm':
+                if (!strcmp(optarg, "tables"))
+                    options.backend = FuncMemory::BACKEND_TABLES;
+                else if (!strcmp(optarg, "flat"))
+                    options.backend = FuncMemory::BACKEND_FLAT;
+                else if (!strcmp(optarg, "flat-thp"))
+                    options.backend = FuncMemory::BACKEND_FLAT_THP;
+                else
+                    usage(argv[0]);
+                break;
+            case 'v':
+                options.memory_stats = true;
+                break;
+            case 'd':
+                data_addr_file = optarg;
+                break;
+            case 'p':
+                options.profile = true;
+                break;
+            case 'i':
+                options.image_cache = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind != 2)
     {
         std::cout << "2 arguments required: mips_exe filename and amount of instrs to run" << endl;
-        std::exit(EXIT_FAILURE);
+        usage(argv[0]);
     }
 
-    MIPS* mips = new MIPS();
-    mips->run(std::string(argv[1]), atoi(argv[2]));
-    delete mips;
+    Trace trace(output, trace_file, is_async);
+    Trace commit_trace_out(commit_trace_file.empty() ? Trace::OUTPUT_NONE : Trace::OUTPUT_FILE,
+                           commit_trace_file, is_async);
+    CommitTraceWriter commit_trace(commit_trace_out);
+
+    if (data_addr_file.empty()) {
+        MIPS mips;
+        simulate(mips, options, argv[optind], atoi(argv[optind + 1]), trace,
+                 commit_trace_file.empty() ? NULL : &commit_trace);
+    } else {
+        DataAddrWriter writer(data_addr_file);
+        BasicMIPS<BatchedMemHook> mips((BatchedMemHook(&writer)));
+        simulate(mips, options, argv[optind], atoi(argv[optind + 1]), trace,
+                 commit_trace_file.empty() ? NULL : &commit_trace);
+    }
 
     return 0;
 }
-
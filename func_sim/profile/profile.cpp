@@ -0,0 +1,111 @@
+/*
+ * profile.cpp - flat profile of mips program by functions
+ * Copyright 2015 MIPT-MIPS
+ */
+
+// Generic C++
+#include <algorithm>
+#include <iomanip>
+
+// MIPT-MIPS modules
+#include <profile.h>
+
+Profile::Profile( const std::string& elf_file_name)
+    : symbols( elf_file_name.c_str())
+    , last_addr( 0)
+    , last_size( 0)
+    , last( NULL)
+{
+    Counters zero = { 0, 0, 0 };
+    counters.assign( symbols.size() + 1, zero);
+}
+
+Profile::Counters& Profile::lookup( uint64 PC)
+{
+    size_t index = symbols.find( PC);
+    if ( index == symbols.size())
+    {
+        return counters.back();
+    }
+    last_addr = symbols[ index].addr;
+    last_size = symbols[ index].size;
+    last = &counters[ index];
+    return *last;
+}
+
+// orders indices of counters by the sort key, the most expensive first
+class ByCost
+{
+        const std::vector<uint64>& costs;
+    public:
+        explicit ByCost( const std::vector<uint64>& costs) : costs( costs) { }
+        bool operator()( size_t a, size_t b) const { return costs[ a] > costs[ b]; }
+};
+
+static double percent( uint64 part, uint64 total)
+{
+    return total != 0 ? 100.0 * part / total : 0;
+}
+
+void Profile::print( std::ostream& out) const
+{
+    Counters total = { 0, 0, 0 };
+    for ( size_t i = 0; i < counters.size(); ++i)
+    {
+        total.instrs += counters[ i].instrs;
+        total.cycles += counters[ i].cycles;
+        total.stalls += counters[ i].stalls;
+    }
+    bool has_cycles = total.cycles != 0;
+
+    std::vector<uint64> costs( counters.size());
+    std::vector<size_t> order;
+    for ( size_t i = 0; i < counters.size(); ++i)
+    {
+        costs[ i] = has_cycles ? counters[ i].cycles : counters[ i].instrs;
+        if ( costs[ i] != 0)
+        {
+            order.push_back( i);
+        }
+    }
+    std::stable_sort( order.begin(), order.end(), ByCost( costs));
+
+    out << "Flat profile: " << total.instrs << " instructions";
+    if ( has_cycles)
+    {
+        out << ", " << total.cycles << " cycles, " << total.stalls << " stalls";
+    }
+    out << std::endl << " %instrs       instrs";
+    if ( has_cycles)
+    {
+        out << "  %cycles       cycles       stalls     CPI";
+    }
+    out << "  function" << std::endl;
+
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision( 2);
+    for ( size_t i = 0; i < order.size(); ++i)
+    {
+        const Counters& entry = counters[ order[ i]];
+        out << std::setw( 8) << percent( entry.instrs, total.instrs)
+            << std::setw( 13) << entry.instrs;
+        if ( has_cycles)
+        {
+            out << std::setw( 9) << percent( entry.cycles, total.cycles)
+                << std::setw( 13) << entry.cycles
+                << std::setw( 13) << entry.stalls
+                << std::setw( 8);
+            if ( entry.instrs != 0)
+            {
+                out << double( entry.cycles) / entry.instrs;
+            } else
+            {
+                out << "-";
+            }
+        }
+        out << "  " << ( order[ i] < symbols.size() ? symbols[ order[ i]].name
+                                                    : std::string( "<no symbol>"))
+            << std::endl;
+    }
+    out.flags( flags);
+}
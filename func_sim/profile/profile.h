@@ -0,0 +1,67 @@
+/*
+ * profile.h - flat profile of mips program by functions
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Generic C++
+#include <iostream>
+#include <string>
+#include <vector>
+
+// MIPT-MIPS modules
+#include <types.h>
+#include <elf_parser.h>
+
+/*
+ * Counts executed instructions, and cycles of performance simulators,
+ * by symbols of the ELF file. Consecutive samples usually come from the
+ * same function, so it is checked first, other ones take binary search.
+ */
+class Profile
+{
+        struct Counters
+        {
+            uint64 instrs;
+            uint64 cycles;
+            uint64 stalls; // cycles without instructions retired
+        };
+
+        ElfSymbolIndex symbols;
+        std::vector<Counters> counters; // per symbol, the last one is for the rest
+
+        // the symbol of the last sample
+        uint64 last_addr;
+        uint64 last_size;
+        Counters* last;
+
+        Counters& find( uint64 PC)
+        {
+            return PC - last_addr < last_size ? *last : lookup( PC);
+        }
+        Counters& lookup( uint64 PC);
+
+    public:
+        explicit Profile( const std::string& elf_file_name);
+
+        void count_instr( uint64 PC) { ++find( PC).instrs; }
+
+        /* A cycle is charged to the instruction which retires in it or stalls. */
+        void count_cycle( uint64 PC, bool is_stall)
+        {
+            Counters& entry = find( PC);
+            ++entry.cycles;
+            if ( is_stall)
+                ++entry.stalls;
+        }
+
+        /*
+         * Prints functions sorted by cycles, or by instructions if there
+         * are no cycles. Functions which are never executed are skipped.
+         */
+        void print( std::ostream& out) const;
+};
+
+#endif // PROFILE_H
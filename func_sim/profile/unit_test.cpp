@@ -0,0 +1,49 @@
+// Generic C++
+#include <sstream>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// MIPT-MIPS modules
+#include <profile.h>
+
+static const char * valid_elf_file = "../func_memory/mips_bin_exmpl.out";
+
+TEST( Profile, Count_Instrs)
+{
+    Profile profile( valid_elf_file);
+    for ( uint64 PC = 0x4000b0; PC < 0x4000c0; PC += 4)
+        profile.count_instr( PC);
+    profile.count_instr( 0x400000); // no symbol
+    profile.count_instr( 0x4000b0);
+
+    std::ostringstream out;
+    profile.print( out);
+    ASSERT_EQ( out.str(), "Flat profile: 6 instructions\n"
+                          " %instrs       instrs  function\n"
+                          "   83.33            5  __start\n"
+                          "   16.67            1  <no symbol>\n");
+}
+
+TEST( Profile, Count_Cycles)
+{
+    Profile profile( valid_elf_file);
+    profile.count_instr( 0x4000b0);
+    profile.count_cycle( 0x4000b0, false);
+    profile.count_cycle( 0x4000b4, true);
+    profile.count_cycle( 0x4000c0, true); // no symbol
+
+    std::ostringstream out;
+    profile.print( out);
+    ASSERT_EQ( out.str(), "Flat profile: 1 instructions, 3 cycles, 2 stalls\n"
+                          " %instrs       instrs  %cycles       cycles       stalls     CPI  function\n"
+                          "  100.00            1    66.67            2            1    2.00  __start\n"
+                          "    0.00            0    33.33            1            1       -  <no symbol>\n");
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -32,6 +32,17 @@ class RF
                 array[reg_num] = instr.get_v_dst();
         }
 
+        inline uint32 read( RegNum reg) const
+        {
+            return array[reg];
+        }
+
+        inline void write( RegNum reg, uint32 value)
+        {
+            if ( REG_NUM_ZERO != reg)
+                array[reg] = value;
+        }
+
         inline void reset( RegNum reg)
         {
             array[reg] = 0;
@@ -0,0 +1,236 @@
+/*
+ * sim_image.cpp - preprocessed images of mips programs for repeated runs
+ * Copyright 2015 MIPT-MIPS
+ */
+
+// Generic C
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Generic C++
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+// MIPT-MIPS modules
+#include <sim_image.h>
+#include <page_image.h>
+
+static const char MAGIC[] = { 'M', 'S', 'I', '1' };
+/*
+ * File layout: header, pages as PageImage keeps them,
+ * decoded instructions and their validity flags.
+ */
+struct Header
+{
+    char magic[ sizeof( MAGIC)];
+    uint32 isa_signature; // see FuncInstr::get_isa_signature
+    uint64 elf_hash;
+    uint64 file_size;
+
+    uint32 start_PC;
+    uint32 text_addr;
+    uint64 text_size;
+
+    PageImage::Layout pages;
+    uint64 text_offset; // decoded instructions follow the pages
+};
+
+uint64 SimImage::hash_file( const std::string& file_name)
+{
+    int fd = open( file_name.c_str(), O_RDONLY);
+    struct stat st;
+    if ( fd < 0 || fstat( fd, &st) != 0)
+    {
+        std::cerr << "ERROR: Could not open file " << file_name
+                  << ": " << strerror( errno) << std::endl;
+        exit( EXIT_FAILURE);
+    }
+
+    size_t size = st.st_size;
+    const uint8* data = NULL;
+    if ( size != 0)
+    {
+        void* ptr = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( ptr == MAP_FAILED)
+        {
+            std::cerr << "ERROR: Could not map file " << file_name
+                      << ": " << strerror( errno) << std::endl;
+            exit( EXIT_FAILURE);
+        }
+        data = static_cast<const uint8*>( ptr);
+    }
+    close( fd);
+
+    // FNV-1a taking a word per step, the tail is taken by bytes
+    const uint64 prime = 1099511628211ull;
+    uint64 hash = 14695981039346656037ull ^ size;
+    size_t i = 0;
+    for ( ; i + sizeof( uint64) <= size; i += sizeof( uint64))
+    {
+        uint64 word;
+        memcpy( &word, data + i, sizeof( word));
+        hash = ( hash ^ word) * prime;
+    }
+    for ( ; i < size; ++i)
+        hash = ( hash ^ data[ i]) * prime;
+
+    if ( data != NULL)
+        munmap( const_cast<uint8*>( data), size);
+
+    // high bits of words reach low bits of the key
+    hash ^= hash >> 29;
+    hash *= prime;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::string SimImage::get_file_name( const std::string& cache_dir, uint64 elf_hash)
+{
+    std::ostringstream name;
+    name << cache_dir << '/' << std::hex << std::setw( 16) << std::setfill( '0')
+         << elf_hash << ".simimg";
+    return name.str();
+}
+
+FuncMemory* SimImage::load( const std::string& elf_file_name,
+                            const std::string& cache_dir, Text& text,
+                            FuncMemory::Backend backend)
+{
+    uint64 elf_hash = hash_file( elf_file_name);
+    std::string file_name = get_file_name( cache_dir, elf_hash);
+    FuncMemory* mem = map( file_name, elf_hash, text, backend);
+    if ( mem != NULL)
+        return mem;
+
+    // parallel runs may make the image at once, each one writes
+    // its own file and the complete one replaces the old image
+    mkdir( cache_dir.c_str(), 0777);
+    std::ostringstream tmp_name;
+    tmp_name << file_name << '.' << getpid() << ".tmp";
+    save( tmp_name.str(), elf_file_name, elf_hash);
+    if ( rename( tmp_name.str().c_str(), file_name.c_str()) != 0)
+    {
+        std::cerr << "ERROR: Could not create sim image " << file_name
+                  << ": " << strerror( errno) << std::endl;
+        unlink( tmp_name.str().c_str());
+        exit( EXIT_FAILURE);
+    }
+
+    mem = map( file_name, elf_hash, text, backend);
+    if ( mem == NULL)
+    {
+        std::cerr << "ERROR: Could not load sim image " << file_name << std::endl;
+        exit( EXIT_FAILURE);
+    }
+    return mem;
+}
+
+void SimImage::save( const std::string& file_name,
+                     const std::string& elf_file_name, uint64 elf_hash)
+{
+    FuncMemory mem( elf_file_name.c_str());
+
+    // the words are taken from the memory, as the simulators fetch them
+    std::vector<ElfSection> sections;
+    ElfSection::getAllElfSections( elf_file_name.c_str(), sections);
+    uint32 text_addr = 0;
+    uint64 text_size = 0;
+    for ( size_t i = 0; i < sections.size(); ++i)
+    {
+        if ( sections[ i].name == ".text")
+        {
+            text_addr = sections[ i].start_addr;
+            text_size = sections[ i].file_size / sizeof( uint32);
+        }
+    }
+
+    Header header;
+    memset( &header, 0, sizeof( header));
+    memcpy( header.magic, MAGIC, sizeof( MAGIC));
+    header.isa_signature = FuncInstr::get_isa_signature();
+    header.elf_hash = elf_hash;
+    header.start_PC = mem.startPC();
+    header.text_addr = text_addr;
+    header.text_size = text_size;
+    std::vector<uint64> pages;
+    PageImage::init( header.pages, mem, sizeof( header), pages);
+    header.text_offset = PageImage::get_end( header.pages);
+    header.file_size = header.text_offset + text_size * ( sizeof( FuncInstr) + 1);
+
+    std::ofstream file( file_name.c_str(), std::ios::binary | std::ios::trunc);
+    if ( !file)
+    {
+        std::cerr << "ERROR: Could not create sim image " << file_name << std::endl;
+        exit( EXIT_FAILURE);
+    }
+
+    file.write( reinterpret_cast<const char*>( &header), sizeof( header));
+    PageImage::write( file, header.pages, sizeof( header), mem, pages);
+
+    std::vector<uint8> is_valid( text_size, 0);
+    std::vector<char> zero( sizeof( FuncInstr), 0);
+    for ( uint64 i = 0; i < text_size; ++i)
+    {
+        uint32 PC = text_addr + i * sizeof( uint32);
+        uint32 bytes = mem.read( PC);
+        if ( FuncInstr::is_known( bytes))
+        {
+            FuncInstr instr( bytes, PC);
+            file.write( reinterpret_cast<const char*>( &instr), sizeof( instr));
+            is_valid[ i] = 1;
+        } else
+        {
+            file.write( zero.data(), zero.size());
+        }
+    }
+    if ( text_size != 0)
+        file.write( reinterpret_cast<const char*>( &is_valid[ 0]), is_valid.size());
+
+    if ( !file.flush())
+    {
+        std::cerr << "ERROR: Could not write sim image " << file_name << std::endl;
+        exit( EXIT_FAILURE);
+    }
+}
+
+FuncMemory* SimImage::map( const std::string& file_name, uint64 elf_hash,
+                           Text& text, FuncMemory::Backend backend)
+{
+    size_t size = 0;
+    uint8* data = PageImage::map_file( file_name, sizeof( Header), size);
+    if ( data == NULL)
+        return NULL;
+
+    const Header& header = *reinterpret_cast<const Header*>( data);
+    bool is_valid = !memcmp( header.magic, MAGIC, sizeof( MAGIC)) &&
+                    header.isa_signature == FuncInstr::get_isa_signature() &&
+                    header.elf_hash == elf_hash &&
+                    header.file_size == size &&
+                    header.text_offset <= size &&
+                    PageImage::check( header.pages, sizeof( Header), header.text_offset) &&
+                    header.file_size == header.text_offset +
+                                        header.text_size * ( sizeof( FuncInstr) + 1);
+    if ( !is_valid)
+    {
+        munmap( data, size);
+        return NULL;
+    }
+
+    FuncMemory* mem = PageImage::map_pages( data, size, header.pages, sizeof( Header),
+                                            header.start_PC, backend);
+
+    text.addr = header.text_addr;
+    text.size = header.text_size;
+    text.instrs = reinterpret_cast<const FuncInstr*>( data + header.text_offset);
+    text.is_valid = data + header.text_offset + header.text_size * sizeof( FuncInstr);
+    return mem;
+}
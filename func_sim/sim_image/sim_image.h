@@ -0,0 +1,64 @@
+/*
+ * sim_image.h - preprocessed images of mips programs for repeated runs
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef SIM_IMAGE_H
+#define SIM_IMAGE_H
+
+// Generic C++
+#include <string>
+
+// MIPT-MIPS modules
+#include <types.h>
+#include <func_instr.h>
+#include <func_memory.h>
+
+/*
+ * Sim image is the loaded program as simulators see it: memory pages
+ * aligned to the host page size, so they are mmap'ed straight from the
+ * file, and decoded instructions of ".text". Images are kept in a cache
+ * directory under the hash of ELF file content, so the ELF file is
+ * parsed and decoded only by the first run, next ones map the image.
+ */
+class SimImage
+{
+    public:
+        /* Decoded instructions of ".text", they live as long as the memory. */
+        struct Text
+        {
+            uint32 addr;
+            uint32 size; // number of instructions
+            const FuncInstr* instrs;
+            const uint8* is_valid; // zero for words of unknown instructions
+        };
+
+        /* Returns the image key: hash of the file content. */
+        static uint64 hash_file( const std::string& file_name);
+
+        /* Returns file name of the image of ELF file in cache_dir. */
+        static std::string get_file_name( const std::string& cache_dir, uint64 elf_hash);
+
+        /*
+         * Creates memory of the ELF file with pages mapped from its image in
+         * cache_dir, the image is made first if there is no valid one.
+         * Flat memory backend copies the pages.
+         */
+        static FuncMemory* load( const std::string& elf_file_name,
+                                 const std::string& cache_dir, Text& text,
+                                 FuncMemory::Backend backend = FuncMemory::BACKEND_TABLES);
+
+        /* Parses and decodes the ELF file and saves its image. */
+        static void save( const std::string& file_name,
+                          const std::string& elf_file_name, uint64 elf_hash);
+
+        /*
+         * Maps the image, returns NULL if it is missing or made from other
+         * ELF file or by a simulator with other instruction decoding.
+         */
+        static FuncMemory* map( const std::string& file_name, uint64 elf_hash,
+                                Text& text,
+                                FuncMemory::Backend backend = FuncMemory::BACKEND_TABLES);
+};
+
+#endif // SIM_IMAGE_H
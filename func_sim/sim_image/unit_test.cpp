@@ -0,0 +1,105 @@
+// generic C
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+// Generic C++
+#include <fstream>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// MIPT-MIPS modules
+#include <sim_image.h>
+
+static const char * valid_elf_file = "../func_memory/mips_bin_exmpl.out";
+static const char * cache_dir = "./sim_image_test";
+
+TEST( SimImage, File_Name)
+{
+    ASSERT_EQ( SimImage::get_file_name( "cache", 0x12abull),
+               std::string( "cache/00000000000012ab.simimg"));
+    ASSERT_EQ( SimImage::hash_file( valid_elf_file),
+               SimImage::hash_file( valid_elf_file));
+}
+
+TEST( SimImage, Save_Map)
+{
+    uint64 hash = SimImage::hash_file( valid_elf_file);
+    std::string file_name = SimImage::get_file_name( cache_dir, hash);
+    unlink( file_name.c_str());
+
+    SimImage::Text text;
+    ASSERT_TRUE( SimImage::map( file_name, hash, text) == NULL);
+
+    // the first load makes the image, the next one maps it
+    FuncMemory* mem = SimImage::load( valid_elf_file, cache_dir, text);
+    ASSERT_TRUE( access( file_name.c_str(), R_OK) == 0);
+    delete mem;
+    mem = SimImage::load( valid_elf_file, cache_dir, text);
+
+    FuncMemory elf_mem( valid_elf_file);
+    ASSERT_EQ( mem->startPC(), elf_mem.startPC());
+    ASSERT_EQ( mem->dump(), elf_mem.dump());
+
+    ASSERT_EQ( text.addr, 0x4000b0u);
+    ASSERT_EQ( text.size, 4u);
+    for ( uint32 i = 0; i < text.size; ++i)
+    {
+        uint32 PC = text.addr + i * 4;
+        ASSERT_EQ( text.instrs[ i].get_bytes(), elf_mem.read( PC));
+        ASSERT_EQ( text.instrs[ i].get_PC(), PC);
+        if ( text.is_valid[ i])
+        {
+            ASSERT_EQ( text.instrs[ i].Dump(), FuncInstr( elf_mem.read( PC), PC).Dump());
+        }
+    }
+
+    // stores change the memory, but not the image
+    mem->write( 0xdeadbeef, 0x4000b0);
+    delete mem;
+    mem = SimImage::load( valid_elf_file, cache_dir, text);
+    ASSERT_EQ( mem->read( 0x4000b0), elf_mem.read( 0x4000b0));
+    delete mem;
+
+    // images of other files are not mapped
+    ASSERT_TRUE( SimImage::map( file_name, hash + 1, text) == NULL);
+    unlink( file_name.c_str());
+}
+
+TEST( SimImage, Rebuild_Broken)
+{
+    uint64 hash = SimImage::hash_file( valid_elf_file);
+    std::string file_name = SimImage::get_file_name( cache_dir, hash);
+    SimImage::Text text;
+    delete SimImage::load( valid_elf_file, cache_dir, text);
+
+    // a truncated image is made again
+    truncate( file_name.c_str(), 100);
+    ASSERT_TRUE( SimImage::map( file_name, hash, text) == NULL);
+    FuncMemory* mem = SimImage::load( valid_elf_file, cache_dir, text);
+    ASSERT_EQ( mem->dump(), FuncMemory( valid_elf_file).dump());
+    delete mem;
+
+    // so is a file of garbage of the same size
+    std::ifstream in( file_name.c_str(), std::ios::binary | std::ios::ate);
+    std::string garbage( in.tellg(), 'x');
+    in.close();
+    std::ofstream out( file_name.c_str(), std::ios::binary | std::ios::trunc);
+    out << garbage;
+    out.close();
+    ASSERT_TRUE( SimImage::map( file_name, hash, text) == NULL);
+    mem = SimImage::load( valid_elf_file, cache_dir, text);
+    ASSERT_EQ( text.size, 4u);
+    delete mem;
+
+    unlink( file_name.c_str());
+    rmdir( cache_dir);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,243 @@
+/*
+ * threaded_engine.cpp - direct-threaded mips functional simulation
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#include <threaded_engine.h>
+
+#ifndef __GNUC__
+#error "Threaded engine requires labels-as-values (GCC or Clang)"
+#endif
+
+ThreadedEngine::ThreadedEngine( RF* rf, FuncMemory* mem, InstrCache* icache,
+                                Trace* trace, CommitTraceWriter* commit_trace) :
+    last_page_num( 0),
+    last_page( NULL),
+    mem( mem),
+    icache( icache),
+    rf( rf),
+    hi( 0),
+    lo( 0),
+    trace( trace),
+    commit_trace( commit_trace),
+    decode_label( NULL),
+    page_end_label( NULL)
+{ }
+
+ThreadedEngine::~ThreadedEngine()
+{
+    for ( PageMap::iterator it = pages.begin(); it != pages.end(); ++it)
+        delete it->second;
+}
+
+ThreadedEngine::Op* ThreadedEngine::find_op( uint32 PC)
+{
+    if ( PC % sizeof( uint32) != 0)
+        return NULL;
+
+    uint32 page_num = PC >> PAGE_BITS;
+    if ( last_page == NULL || last_page_num != page_num)
+    {
+        PageMap::iterator it = pages.find( page_num);
+        if ( it == pages.end())
+        {
+            Page* page = new Page;
+            for ( size_t i = 0; i < PAGE_INSTRS; ++i)
+                page->op[ i].label = decode_label;
+            page->op[ PAGE_INSTRS].label = page_end_label;
+            it = pages.insert( PageMap::value_type( page_num, page)).first;
+        }
+        last_page_num = page_num;
+        last_page = it->second;
+    }
+    return &last_page->op[ ( PC & ( ( 1 << PAGE_BITS) - 1)) / sizeof( uint32)];
+}
+
+void ThreadedEngine::invalidate( uint32 addr, uint32 num_of_bytes)
+{
+    uint32 words[] = { addr, addr + num_of_bytes - 1 };
+    for ( size_t i = 0; i < 2; ++i)
+    {
+        PageMap::iterator it = pages.find( words[ i] >> PAGE_BITS);
+        if ( it != pages.end())
+            it->second->op[ ( words[ i] & ( ( 1 << PAGE_BITS) - 1)) / sizeof( uint32)].label = decode_label;
+    }
+}
+
+OpKind ThreadedEngine::predecode( Op& op, const FuncInstr& instr)
+{
+    op.src1 = instr.get_src1_num();
+    op.src2 = instr.get_src2_num();
+    op.dst  = ( instr.get_dst_num() == REG_NUM_ZERO) ? REG_NUM_MAX : instr.get_dst_num();
+    op.mem_size = instr.get_mem_size();
+    op.imm = instr.get_target_imm();
+    op.instr = &instr;
+    return instr.get_op_kind();
+}
+
+void ThreadedEngine::dump( const Op& op, uint32 result, uint32 mem_addr) const
+{
+    if ( trace != NULL)
+    {
+        FuncInstr instr = *op.instr;
+        instr.set_result( result);
+        *trace << instr << '\n';
+    }
+    if ( commit_trace != NULL)
+    {
+        const FuncInstr& instr = *op.instr;
+        CommitRecord record = { instr.get_PC(), instr.get_bytes(),
+                                uint8( instr.get_dst_num()), result,
+                                instr.is_load() || instr.is_store(), mem_addr };
+        commit_trace->write( record);
+    }
+}
+
+/*
+ * Every handler ends with NEXT or JUMP, which dispatch the following
+ * operation. FuncInstr::execute_* semantics are reproduced exactly.
+ */
+#define R( field) reg[ op->field]
+
+#define NEXT() \
+    do { \
+        if ( trace != NULL || commit_trace != NULL) \
+            dump( *op, reg[ op->dst], addr); \
+        pc += sizeof( uint32); \
+        ++op; \
+        if ( ++executed == instrs_to_run) \
+            goto out; \
+        goto *op->label; \
+    } while ( 0)
+
+#define JUMP( target) \
+    do { \
+        if ( trace != NULL || commit_trace != NULL) \
+            dump( *op, reg[ op->dst], addr); \
+        pc = ( target); \
+        if ( ++executed == instrs_to_run) \
+            goto out; \
+        op = find_op( pc); \
+        if ( op == NULL) \
+            goto out; \
+        goto *op->label; \
+    } while ( 0)
+
+uint32 ThreadedEngine::run( uint32& PC, uint32 instrs_to_run)
+{
+    // in the order of OpKind
+    static const void* const labels[] =
+    {
+        &&do_add, &&do_addu, &&do_sub, &&do_subu, &&do_addi, &&do_addiu,
+        &&do_mult, &&do_div, &&do_mfhi, &&do_mthi, &&do_mflo, &&do_mtlo,
+        &&do_sll, &&do_srl, &&do_sllv, &&do_srlv, &&do_lui, &&do_slt, &&do_slti,
+        &&do_and, &&do_or, &&do_xor, &&do_nor, &&do_andi, &&do_ori, &&do_xori,
+        &&do_beq, &&do_bne, &&do_blez, &&do_bgtz, &&do_j, &&do_jal, &&do_jr, &&do_jalr,
+        &&do_nop, &&do_load, &&do_store
+    };
+    static_assert( sizeof( labels) / sizeof( labels[0]) == OP_KINDS_NUM,
+                   "labels must be in the order of OpKind");
+    decode_label = &&decode;
+    page_end_label = &&page_end;
+
+    // architectural state, the extra register is a sink for writes to $zero
+    uint32 reg[ REG_NUM_MAX + 1];
+    uint32 pc = PC;
+    uint32 HI = hi;
+    uint32 LO = lo;
+
+    uint32 executed = 0;
+    Op* op = NULL;
+    const FuncInstr* instr = NULL;
+    uint64 mult_res = 0;
+    uint32 addr = 0;
+
+    for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+        reg[ i] = rf->read( (RegNum)i);
+    reg[ REG_NUM_MAX] = 0;
+
+    if ( instrs_to_run == 0)
+        goto out;
+
+    op = find_op( pc);
+    if ( op == NULL)
+        goto out;
+    goto *op->label;
+
+decode:
+    instr = icache->decode( *mem, pc);
+    if ( instr == NULL)
+        goto out; // to be executed by the interpreter
+    op->label = labels[ predecode( *op, *instr)];
+    goto *op->label;
+
+page_end:
+    op = find_op( pc);
+    goto *op->label;
+
+do_add:   R( dst) = (int32)R( src1) + (int32)R( src2); NEXT();
+do_addu:  R( dst) = R( src1) + R( src2); NEXT();
+do_sub:   R( dst) = (int32)R( src1) - (int32)R( src2); NEXT();
+do_subu:  R( dst) = R( src1) - R( src2); NEXT();
+do_addi:  R( dst) = (int32)R( src1) + (int16)op->imm; NEXT();
+do_addiu: R( dst) = R( src1) + op->imm; NEXT();
+
+do_mult:
+    mult_res = R( src1) * R( src2);
+    LO = mult_res & 0xFFFFFFFF;
+    HI = mult_res >> 0x20;
+    NEXT();
+do_div:
+    LO = R( src2) / R( src1);
+    HI = R( src2) % R( src1);
+    NEXT();
+do_mfhi:  R( dst) = HI; NEXT();
+do_mthi:  HI = R( src2); NEXT();
+do_mflo:  R( dst) = LO; NEXT();
+do_mtlo:  LO = R( src2); NEXT();
+
+do_sll:   R( dst) = R( src1) << op->imm; NEXT();
+do_srl:   R( dst) = R( src1) >> op->imm; NEXT();
+do_sllv:  R( dst) = R( src1) << R( src2); NEXT();
+do_srlv:  R( dst) = R( src1) >> R( src2); NEXT();
+do_lui:   R( dst) = op->imm << 0x10; NEXT();
+do_slt:   R( dst) = R( src2) < R( src1); NEXT();
+do_slti:  R( dst) = R( src2) < op->imm; NEXT();
+
+do_and:   R( dst) = R( src1) & R( src2); NEXT();
+do_or:    R( dst) = R( src1) | R( src2); NEXT();
+do_xor:   R( dst) = R( src1) ^ R( src2); NEXT();
+do_nor:   R( dst) = ~( R( src1) | R( src2)); NEXT();
+do_andi:  R( dst) = R( src1) & op->imm; NEXT();
+do_ori:   R( dst) = R( src1) | op->imm; NEXT();
+do_xori:  R( dst) = R( src1) ^ op->imm; NEXT();
+
+do_beq:   if ( R( src1) == R( src2)) JUMP( op->imm); NEXT();
+do_bne:   if ( R( src1) != R( src2)) JUMP( op->imm); NEXT();
+do_blez:  if ( R( src1) <= 0) JUMP( op->imm); NEXT();
+do_bgtz:  if ( R( src1) <= R( src2)) JUMP( op->imm); NEXT();
+do_j:     JUMP( op->imm);
+do_jal:   R( dst) = pc + sizeof( uint32); JUMP( op->imm);
+do_jr:    JUMP( R( src1));
+do_jalr:  addr = R( src2); R( dst) = pc + sizeof( uint32); JUMP( addr);
+do_nop:   NEXT();
+
+do_load:
+    addr = R( src1) + op->imm;
+    R( dst) = mem->read( addr, op->mem_size);
+    NEXT();
+do_store:
+    addr = R( src1) + op->imm;
+    mem->write( R( src2), addr, op->mem_size);
+    if ( icache->invalidate( addr, op->mem_size))
+        invalidate( addr, op->mem_size);
+    NEXT();
+
+out:
+    for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+        rf->write( (RegNum)i, reg[ i]);
+    hi = HI;
+    lo = LO;
+    PC = pc;
+    return executed;
+}
@@ -0,0 +1,83 @@
+/*
+ * threaded_engine.h - direct-threaded mips functional simulation
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef THREADED_ENGINE_H
+#define THREADED_ENGINE_H
+
+#include <map>
+
+#include <func_instr.h>
+#include <func_memory.h>
+#include <instr_cache.h>
+#include <rf.h>
+#include <trace.h>
+#include <commit_trace.h>
+
+/*
+ * Predecoded code is stored in pages like InstrCache does. Each operation
+ * holds the address of its handler label (GCC/Clang labels-as-values),
+ * so execution is one indirect jump per instruction. Registers, PC and
+ * hi/lo are kept in locals of run().
+ */
+class ThreadedEngine
+{
+        static const uint32 PAGE_BITS = 12;
+        static const uint32 PAGE_INSTRS = ( 1 << PAGE_BITS) / sizeof( uint32);
+
+        struct Op
+        {
+            const void* label; // handler, or the decoder if not decoded yet
+            uint8 src1;
+            uint8 src2;
+            uint8 dst;
+            uint8 mem_size;
+            uint32 imm; // immediate or target address of a jump
+            const FuncInstr* instr; // decoded instruction, used for the trace
+        };
+
+        struct Page
+        {
+            Op op[ PAGE_INSTRS + 1]; // the last one leaves the page
+        };
+
+        typedef std::map<uint32, Page*> PageMap;
+        PageMap pages;
+        uint32 last_page_num;
+        Page* last_page;
+
+        FuncMemory* mem;
+        InstrCache* icache;
+        RF* rf;
+        uint32 hi;
+        uint32 lo;
+        Trace* trace; // NULL if no trace is printed
+        CommitTraceWriter* commit_trace; // NULL if no commit trace is written
+
+        // labels of run() which are needed outside of it
+        const void* decode_label;
+        const void* page_end_label;
+
+        Op* find_op( uint32 PC);
+        static OpKind predecode( Op& op, const FuncInstr& instr);
+        void dump( const Op& op, uint32 result, uint32 mem_addr) const;
+
+    public:
+        ThreadedEngine( RF* rf, FuncMemory* mem, InstrCache* icache,
+                        Trace* trace, CommitTraceWriter* commit_trace);
+        ~ThreadedEngine();
+
+        /*
+         * Executes up to instrs_to_run instructions starting from PC,
+         * PC is updated. Returns number of executed instructions, it is
+         * less than requested if the code at PC cannot be predecoded and
+         * one instruction should be executed by the interpreter.
+         */
+        uint32 run( uint32& PC, uint32 instrs_to_run);
+
+        /* Drops predecoded operations overwritten by a store. */
+        void invalidate( uint32 addr, uint32 num_of_bytes);
+};
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * commit_trace.cpp - compact binary trace of committed instructions
+ * Copyright 2015 MIPT-MIPS
+ */
+
+// Generic C
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Generic C++
+#include <iomanip>
+#include <iostream>
+
+// MIPT-MIPS modules
+#include <commit_trace.h>
+
+static const char MAGIC[] = { 'M', 'C', 'T', '2' };
+
+bool CommitRecord::operator==( const CommitRecord& that) const
+{
+    return PC == that.PC && bytes == that.bytes &&
+           dst == that.dst && ( dst == 0 || value == that.value) &&
+           is_mem == that.is_mem && ( !is_mem || mem_addr == that.mem_addr);
+}
+
+std::ostream& operator<<( std::ostream& out, const CommitRecord& record)
+{
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::hex << std::setfill( '0')
+        << "PC 0x" << std::setw( 8) << record.PC
+        << ": 0x" << std::setw( 8) << record.bytes;
+    if ( record.dst != 0)
+        out << "\t[ $" << std::dec << unsigned( record.dst)
+            << " = 0x" << std::hex << record.value << "]";
+    if ( record.is_mem)
+        out << "\t[ mem 0x" << record.mem_addr << "]";
+    out.flags( flags);
+    return out;
+}
+
+void CommitTraceModel::reset( uint32 start_PC)
+{
+    next_PC = start_PC;
+    mem_addr = 0;
+    for ( size_t i = 0; i < REG_NUM; ++i)
+        reg[ i] = 0;
+    for ( size_t i = 0; i < CACHE_SIZE; ++i)
+    {
+        cache_PC[ i] = cache_bytes[ i] = 0;
+        cache_dst[ i] = 0;
+    }
+}
+
+void CommitTraceWriter::put_varint( uint32 value)
+{
+    while ( value >= 0x80)
+    {
+        out.put( ( value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out.put( value);
+}
+
+void CommitTraceWriter::put_word( uint32 value)
+{
+    for ( size_t i = 0; i < sizeof( value); ++i)
+        out.put( value >> ( 8 * i));
+}
+
+void CommitTraceWriter::write_header( const std::string& elf_name, uint32 start_PC)
+{
+    out.write( MAGIC, sizeof( MAGIC));
+    put_varint( elf_name.size());
+    out.write( elf_name.data(), elf_name.size());
+    put_word( start_PC);
+    reset( start_PC);
+}
+
+void CommitTraceWriter::write( const CommitRecord& record)
+{
+    uint32 index = cache_index( record.PC);
+    uint8 flags = 0;
+    if ( record.PC != next_PC)
+        flags |= FLAG_JUMP;
+    if ( cache_PC[ index] != record.PC || cache_bytes[ index] != record.bytes ||
+         cache_dst[ index] != record.dst)
+        flags |= FLAG_BYTES;
+    uint32& reg_value = reg[ record.dst % REG_NUM];
+    if ( record.dst != 0 && record.value != reg_value)
+        flags |= FLAG_DST;
+    if ( record.is_mem)
+        flags |= FLAG_MEM;
+
+    out.put( flags);
+    if ( flags & FLAG_JUMP)
+        put_varint( zigzag( record.PC - next_PC));
+    if ( flags & FLAG_BYTES)
+    {
+        put_word( record.bytes);
+        out.put( record.dst);
+        cache_PC[ index] = record.PC;
+        cache_bytes[ index] = record.bytes;
+        cache_dst[ index] = record.dst;
+    }
+    if ( flags & FLAG_DST)
+    {
+        put_varint( zigzag( record.value - reg_value));
+        reg_value = record.value;
+    }
+    if ( flags & FLAG_MEM)
+    {
+        put_varint( zigzag( record.mem_addr - mem_addr));
+        mem_addr = record.mem_addr;
+    }
+    next_PC = record.PC + 4;
+}
+
+CommitTraceReader::CommitTraceReader( const std::string& file_name) :
+    file_name( file_name),
+    buffer( BUFFER_SIZE),
+    pos( 0),
+    size( 0)
+{
+    fd = open( file_name.c_str(), O_RDONLY);
+    if ( fd < 0)
+    {
+        std::cerr << "ERROR: Could not open commit trace " << file_name
+                  << ": " << strerror( errno) << std::endl;
+        exit( EXIT_FAILURE);
+    }
+
+    for ( size_t i = 0; i < sizeof( MAGIC); ++i)
+        if ( !fill() || get_byte() != uint8( MAGIC[ i]))
+        {
+            std::cerr << "ERROR: " << file_name << " is not a commit trace" << std::endl;
+            exit( EXIT_FAILURE);
+        }
+
+    elf_name.resize( get_varint());
+    for ( size_t i = 0; i < elf_name.size(); ++i)
+        elf_name[ i] = get_byte();
+    start_PC = get_word();
+    reset( start_PC);
+}
+
+CommitTraceReader::~CommitTraceReader()
+{
+    close( fd);
+}
+
+bool CommitTraceReader::fill()
+{
+    if ( pos < size)
+        return true;
+
+    ssize_t result;
+    do
+        result = ::read( fd, &buffer[ 0], buffer.size());
+    while ( result < 0 && errno == EINTR);
+
+    if ( result < 0)
+    {
+        std::cerr << "ERROR: Could not read commit trace " << file_name
+                  << ": " << strerror( errno) << std::endl;
+        exit( EXIT_FAILURE);
+    }
+    pos = 0;
+    size = result;
+    return size != 0;
+}
+
+uint8 CommitTraceReader::get_byte()
+{
+    if ( !fill())
+    {
+        std::cerr << "ERROR: Commit trace " << file_name << " is truncated" << std::endl;
+        exit( EXIT_FAILURE);
+    }
+    return buffer[ pos++];
+}
+
+uint32 CommitTraceReader::get_varint()
+{
+    uint32 value = 0;
+    for ( size_t shift = 0; shift < 32; shift += 7)
+    {
+        uint8 byte = get_byte();
+        value |= uint32( byte & 0x7F) << shift;
+        if ( ( byte & 0x80) == 0)
+            break;
+    }
+    return value;
+}
+
+uint32 CommitTraceReader::get_word()
+{
+    uint32 value = 0;
+    for ( size_t i = 0; i < sizeof( value); ++i)
+        value |= uint32( get_byte()) << ( 8 * i);
+    return value;
+}
+
+bool CommitTraceReader::read( CommitRecord& record)
+{
+    if ( !fill())
+        return false;
+
+    uint8 flags = get_byte();
+    record.PC = next_PC;
+    if ( flags & FLAG_JUMP)
+        record.PC += unzigzag( get_varint());
+
+    uint32 index = cache_index( record.PC);
+    if ( flags & FLAG_BYTES)
+    {
+        cache_PC[ index] = record.PC;
+        cache_bytes[ index] = get_word();
+        cache_dst[ index] = get_byte();
+    }
+    record.bytes = cache_bytes[ index];
+    record.dst = cache_dst[ index];
+
+    record.value = 0;
+    if ( record.dst != 0)
+    {
+        uint32& reg_value = reg[ record.dst % REG_NUM];
+        if ( flags & FLAG_DST)
+            reg_value += unzigzag( get_varint());
+        record.value = reg_value;
+    }
+
+    record.is_mem = ( flags & FLAG_MEM) != 0;
+    record.mem_addr = 0;
+    if ( record.is_mem)
+    {
+        mem_addr += unzigzag( get_varint());
+        record.mem_addr = mem_addr;
+    }
+
+    next_PC = record.PC + 4;
+    return true;
+}
@@ -0,0 +1,113 @@
+/*
+ * commit_trace.h - compact binary trace of committed instructions
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef COMMIT_TRACE_H
+#define COMMIT_TRACE_H
+
+// Generic C++
+#include <ostream>
+#include <string>
+#include <vector>
+
+// MIPT-MIPS modules
+#include <types.h>
+
+/* What an instruction has done, as seen by the programmer. */
+struct CommitRecord
+{
+    uint32 PC;
+    uint32 bytes;    // raw instruction word
+    uint8 dst;       // destination register, 0 if there is none
+    uint32 value;    // value written to dst
+    bool is_mem;     // is load or store
+    uint32 mem_addr;
+
+    bool operator==( const CommitRecord& that) const;
+    bool operator!=( const CommitRecord& that) const { return !( *this == that); }
+};
+
+std::ostream& operator<<( std::ostream& out, const CommitRecord& record);
+
+/*
+ * File format: header ("MCT2", varint length and name of ELF file,
+ * 4-byte start PC) followed by records. Every record starts with a byte
+ * of flags, then come only the fields which cannot be predicted:
+ *  - PC delta from the next sequential PC, if it is a jump;
+ *  - instruction word and destination register, if the word is not
+ *    the one seen at the same PC before;
+ *  - delta from the previous value of the register, if it is changed;
+ *  - delta from the previous memory address, if memory is accessed.
+ * Deltas are zigzag varints, all numbers are little-endian.
+ */
+class CommitTraceModel
+{
+    protected:
+        static const uint8 FLAG_JUMP  = 1 << 0;
+        static const uint8 FLAG_BYTES = 1 << 1;
+        static const uint8 FLAG_DST   = 1 << 2;
+        static const uint8 FLAG_MEM   = 1 << 3;
+
+        static const uint32 CACHE_SIZE = 4096;
+        static const uint32 REG_NUM = 32;
+
+        // state shared by writer and reader, it predicts the next record
+        uint32 next_PC;
+        uint32 reg[ REG_NUM];
+        uint32 mem_addr;
+        uint32 cache_PC[ CACHE_SIZE];
+        uint32 cache_bytes[ CACHE_SIZE];
+        uint8 cache_dst[ CACHE_SIZE]; // is defined by the word
+
+        void reset( uint32 start_PC);
+        static uint32 cache_index( uint32 PC) { return ( PC >> 2) % CACHE_SIZE; }
+        static uint32 zigzag( int32 value) { return ( uint32( value) << 1) ^ uint32( value >> 31); }
+        static int32 unzigzag( uint32 value) { return int32( ( value >> 1) ^ ( 0 - ( value & 1))); }
+};
+
+class CommitTraceWriter : private CommitTraceModel
+{
+        std::ostream& out;
+
+        void put_varint( uint32 value);
+        void put_word( uint32 value);
+
+    public:
+        CommitTraceWriter( std::ostream& out) : out( out) { }
+
+        /* Starts the trace, must be called before the first record. */
+        void write_header( const std::string& elf_name, uint32 start_PC);
+        void write( const CommitRecord& record);
+};
+
+class CommitTraceReader : private CommitTraceModel
+{
+        static const size_t BUFFER_SIZE = 1 << 20;
+
+        std::string file_name;
+        int fd;
+        std::vector<uint8> buffer;
+        size_t pos;
+        size_t size;
+
+        std::string elf_name;
+        uint32 start_PC;
+
+        bool fill(); // returns false at the end of file
+        uint8 get_byte();
+        uint32 get_varint();
+        uint32 get_word();
+
+    public:
+        CommitTraceReader( const std::string& file_name);
+        ~CommitTraceReader();
+
+        const std::string& get_elf_name() const { return elf_name; }
+        uint32 get_start_PC() const { return start_PC; }
+
+        /* Reads the next record, returns false at the end of trace. */
+        bool read( CommitRecord& record);
+};
+
+#endif // COMMIT_TRACE_H
@@ -0,0 +1,164 @@
+/*
+ * trace.cpp - buffered writer of simulation traces
+ * Copyright 2015 MIPT-MIPS
+ */
+
+// Generic C
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+// Generic C++
+#include <iostream>
+
+// MIPT-MIPS modules
+#include <trace.h>
+
+Trace* Trace::first = NULL;
+
+Trace::Trace( Output output, const std::string& file_name, bool is_async) :
+    std::ostream( this),
+    output( output),
+    fd( STDOUT_FILENO),
+    is_async( is_async && output != OUTPUT_NONE),
+    head( 0),
+    tail( 0),
+    is_done( false)
+{
+    if ( output == OUTPUT_FILE)
+    {
+        fd = open( file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ( fd < 0)
+        {
+            std::cerr << "ERROR: Could not open trace file " << file_name
+                      << ": " << strerror( errno) << std::endl;
+            exit( EXIT_FAILURE);
+        }
+    }
+
+    storage.resize( this->is_async ? CHUNK_NUM * CHUNK_SIZE : CHUNK_SIZE);
+    setp( get_chunk( 0), get_chunk( 0) + CHUNK_SIZE);
+
+    if ( this->is_async && pthread_create( &writer, NULL, writer_loop, this) != 0)
+    {
+        std::cerr << "ERROR: Could not start trace writer thread" << std::endl;
+        exit( EXIT_FAILURE);
+    }
+
+    // simulators exit() on errors, the trace before the error is needed
+    if ( first == NULL)
+        atexit( flush_all);
+    next = first;
+    first = this;
+}
+
+Trace::~Trace()
+{
+    for ( Trace** it = &first; *it != NULL; it = &( *it)->next)
+        if ( *it == this)
+        {
+            *it = next;
+            break;
+        }
+
+    sync();
+    if ( is_async)
+    {
+        is_done.store( true, std::memory_order_release);
+        pthread_join( writer, NULL);
+    }
+    if ( output == OUTPUT_FILE)
+        close( fd);
+}
+
+void Trace::flush_all()
+{
+    for ( Trace* it = first; it != NULL; it = it->next)
+        it->sync();
+}
+
+void Trace::write_all( const char* data, size_t size)
+{
+    while ( size > 0)
+    {
+        ssize_t written = ::write( fd, data, size);
+        if ( written < 0 && errno == EINTR)
+            continue;
+        if ( written < 0)
+        {
+            // _Exit() as exit() handlers would wait for this very thread
+            std::cerr << "ERROR: Could not write trace: " << strerror( errno) << std::endl;
+            _Exit( EXIT_FAILURE);
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+/* Passes the current chunk to the output and starts the next one. */
+void Trace::submit()
+{
+    size_t size = pptr() - pbase();
+    if ( !is_async)
+    {
+        if ( output != OUTPUT_NONE)
+            write_all( pbase(), size);
+        setp( pbase(), epptr());
+        return;
+    }
+
+    uint64 num = head.load( std::memory_order_relaxed);
+    chunk_size[ num % CHUNK_NUM] = size;
+    head.store( num + 1, std::memory_order_release);
+
+    // wait until the writer frees the next chunk
+    while ( num + 1 - tail.load( std::memory_order_acquire) >= CHUNK_NUM)
+        sched_yield();
+
+    setp( get_chunk( num + 1), get_chunk( num + 1) + CHUNK_SIZE);
+}
+
+void* Trace::writer_loop( void* trace)
+{
+    Trace* self = static_cast<Trace*>( trace);
+    while ( true)
+    {
+        uint64 num = self->tail.load( std::memory_order_relaxed);
+        if ( num == self->head.load( std::memory_order_acquire))
+        {
+            if ( self->is_done.load( std::memory_order_acquire) &&
+                 num == self->head.load( std::memory_order_acquire))
+                return NULL;
+            usleep( 100);
+            continue;
+        }
+
+        self->write_all( self->get_chunk( num), self->chunk_size[ num % CHUNK_NUM]);
+        self->tail.store( num + 1, std::memory_order_release);
+    }
+}
+
+int Trace::overflow( int c)
+{
+    submit();
+    if ( c != EOF)
+    {
+        *pptr() = c;
+        pbump( 1);
+    }
+    return c == EOF ? 0 : c;
+}
+
+int Trace::sync()
+{
+    if ( pptr() != pbase())
+        submit();
+
+    // everything submitted is written when sync() returns
+    while ( tail.load( std::memory_order_acquire) != head.load( std::memory_order_relaxed))
+        sched_yield();
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * trace.h - buffered writer of simulation traces
+ * Copyright 2015 MIPT-MIPS
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// Generic C
+#include <pthread.h>
+
+// Generic C++
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// MIPT-MIPS modules
+#include <types.h>
+
+/*
+ * Trace is an output stream collecting data in large chunks, so a line
+ * of trace costs no system call. A full chunk is either written at once
+ * or, in asynchronous mode, passed through a lock-free ring to a writer
+ * thread while simulation continues in the next chunk.
+ *
+ * Use '\n' rather than std::endl: every flush waits for the data
+ * to reach the output.
+ */
+class Trace : private std::streambuf, public std::ostream
+{
+    public:
+        enum Output
+        {
+            OUTPUT_STDOUT,
+            OUTPUT_FILE,
+            OUTPUT_NONE
+        };
+
+        Trace( Output output = OUTPUT_STDOUT,
+               const std::string& file_name = "",
+               bool is_async = false);
+        ~Trace();
+
+        bool is_enabled() const { return output != OUTPUT_NONE; }
+
+    private:
+        static const size_t CHUNK_SIZE = 1 << 20;
+        static const size_t CHUNK_NUM = 8; // used by asynchronous mode only
+
+        Output output;
+        int fd;
+        bool is_async;
+
+        std::vector<char> storage;
+        size_t chunk_size[ CHUNK_NUM];
+        std::atomic<uint64> head; // chunks submitted by simulation
+        std::atomic<uint64> tail; // chunks written by the writer thread
+        std::atomic<bool> is_done;
+        pthread_t writer;
+
+        // the list of traces to be flushed at exit()
+        Trace* next;
+        static Trace* first;
+        static void flush_all();
+
+        char* get_chunk( uint64 num) { return &storage[ ( num % CHUNK_NUM) * CHUNK_SIZE]; }
+        void submit();
+        void write_all( const char* data, size_t size);
+        static void* writer_loop( void* trace);
+
+        // std::streambuf interface
+        int overflow( int c);
+        int sync();
+
+        Trace( const Trace&);
+        Trace& operator=( const Trace&);
+};
+
+#endif // TRACE_H
@@ -0,0 +1,58 @@
+/*
+ * trace_diff.cpp - finds the first difference of two commit traces
+ * Copyright 2015 MIPT-MIPS
+ */
+
+// Generic C
+#include <cstdlib>
+
+// Generic C++
+#include <iostream>
+
+// MIPT-MIPS modules
+#include <commit_trace.h>
+
+int main( int argc, char* argv[])
+{
+    if ( argc != 3)
+    {
+        std::cerr << "ERROR: Wrong number of arguments! Usage: "
+                  << argv[ 0] << " trace_a trace_b" << std::endl;
+        std::exit( EXIT_FAILURE);
+    }
+
+    CommitTraceReader a( argv[ 1]);
+    CommitTraceReader b( argv[ 2]);
+    if ( a.get_elf_name() != b.get_elf_name() || a.get_start_PC() != b.get_start_PC())
+        std::cout << "WARNING: traces are made for different programs: "
+                  << a.get_elf_name() << " and " << b.get_elf_name() << std::endl;
+
+    CommitRecord record_a;
+    CommitRecord record_b;
+    for ( uint64 index = 0;; ++index)
+    {
+        bool has_a = a.read( record_a);
+        bool has_b = b.read( record_b);
+
+        if ( !has_a && !has_b)
+        {
+            std::cout << "identical, " << index << " records" << std::endl;
+            return 0;
+        }
+        if ( !has_a || !has_b)
+        {
+            std::cout << "record " << index << ": "
+                      << argv[ has_a ? 2 : 1] << " has ended, "
+                      << argv[ has_a ? 1 : 2] << " continues with" << std::endl
+                      << "    " << ( has_a ? record_a : record_b) << std::endl;
+            return 1;
+        }
+        if ( record_a != record_b)
+        {
+            std::cout << "record " << index << " differs:" << std::endl
+                      << "    " << argv[ 1] << ": " << record_a << std::endl
+                      << "    " << argv[ 2] << ": " << record_b << std::endl;
+            return 1;
+        }
+    }
+}
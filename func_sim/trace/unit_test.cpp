@@ -0,0 +1,176 @@
+// generic C
+#include <cstdlib>
+#include <unistd.h>
+
+// generic C++
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// MIPT-MIPS modules
+#include <trace.h>
+#include <commit_trace.h>
+
+static const char * trace_file = "./trace_test.txt";
+
+static std::string read_file( const char* name)
+{
+    std::ifstream file( name);
+    std::ostringstream oss;
+    oss << file.rdbuf();
+    return oss.str();
+}
+
+TEST( Trace_init, Process_Wrong_File)
+{
+    // must exit and return EXIT_FAILURE
+    ASSERT_EXIT( Trace trace( Trace::OUTPUT_FILE, "./1234567890/qwertyuiop"),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+}
+
+TEST( Trace, Write_To_File)
+{
+    {
+        Trace trace( Trace::OUTPUT_FILE, trace_file);
+        ASSERT_TRUE( trace.is_enabled());
+        trace << "add $t0, $t1, $t2" << '\n' << std::hex << 0x10 << '\n';
+    }
+    ASSERT_EQ( read_file( trace_file), "add $t0, $t1, $t2\n10\n");
+
+    // flush makes buffered data visible
+    Trace trace( Trace::OUTPUT_FILE, trace_file);
+    trace << "line" << '\n';
+    ASSERT_EQ( read_file( trace_file), "");
+    trace.flush();
+    ASSERT_EQ( read_file( trace_file), "line\n");
+    unlink( trace_file);
+}
+
+TEST( Trace, Write_Many_Chunks)
+{
+    // more than all the chunks of the asynchronous ring together
+    std::ostringstream expected;
+    for ( int i = 0; i < 1000000; ++i)
+        expected << "instruction " << i << '\n';
+
+    for ( int is_async = 0; is_async < 2; ++is_async)
+    {
+        {
+            Trace trace( Trace::OUTPUT_FILE, trace_file, is_async);
+            for ( int i = 0; i < 1000000; ++i)
+                trace << "instruction " << i << '\n';
+        }
+        ASSERT_EQ( read_file( trace_file), expected.str());
+    }
+    unlink( trace_file);
+}
+
+TEST( Trace, Flush_At_Exit)
+{
+    // the trace is written if the simulator exits on an error
+    ASSERT_EXIT( { Trace* trace = new Trace( Trace::OUTPUT_FILE, trace_file, true);
+                   *trace << "last line" << '\n';
+                   exit( EXIT_FAILURE); },
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "");
+    ASSERT_EQ( read_file( trace_file), "last line\n");
+    unlink( trace_file);
+}
+
+TEST( Trace, Output_None)
+{
+    Trace trace( Trace::OUTPUT_NONE);
+    ASSERT_FALSE( trace.is_enabled());
+    for ( int i = 0; i < 1000000; ++i)
+        trace << "instruction " << i << '\n';
+    trace.flush();
+}
+
+static CommitRecord make_record( uint32 PC, uint32 bytes, uint8 dst, uint32 value,
+                                 bool is_mem = false, uint32 mem_addr = 0)
+{
+    CommitRecord record = { PC, bytes, dst, value, is_mem, mem_addr };
+    return record;
+}
+
+TEST( Commit_Trace, Write_Read)
+{
+    std::vector<CommitRecord> records;
+    records.push_back( make_record( 0x400000, 0x3c100041, 16, 0x410000));
+    records.push_back( make_record( 0x400004, 0x8e080000, 8, 0xdeadbeef, true, 0x410000));
+    records.push_back( make_record( 0x400008, 0xae080004, 0, 0, true, 0x410004));
+    records.push_back( make_record( 0x40000c, 0x1509fffc, 0, 0));
+    records.push_back( make_record( 0x400000, 0x3c100041, 16, 0x410000)); // backward jump
+    records.push_back( make_record( 0x400004, 0x8e080000, 8, 0xdeadbeef, true, 0x410000)); // same value
+    records.push_back( make_record( 0x400004, 0x12345678, 8, 0)); // overwritten code
+    records.push_back( make_record( 0x400004, 0x12345678, 9, 1)); // same word, other register
+    records.push_back( make_record( 0x7ffffffc, 0x08100000, 0, 0)); // far jump
+
+    {
+        Trace trace( Trace::OUTPUT_FILE, trace_file);
+        CommitTraceWriter writer( trace);
+        writer.write_header( "test.out", 0x400000);
+        for ( size_t i = 0; i < records.size(); ++i)
+            writer.write( records[ i]);
+    }
+
+    CommitTraceReader reader( trace_file);
+    ASSERT_EQ( reader.get_elf_name(), "test.out");
+    ASSERT_EQ( reader.get_start_PC(), 0x400000u);
+
+    CommitRecord record;
+    for ( size_t i = 0; i < records.size(); ++i)
+    {
+        ASSERT_TRUE( reader.read( record));
+        ASSERT_EQ( record, records[ i]);
+        ASSERT_EQ( record.value, records[ i].value);
+        ASSERT_EQ( record.mem_addr, records[ i].mem_addr);
+    }
+    ASSERT_FALSE( reader.read( record));
+    unlink( trace_file);
+}
+
+TEST( Commit_Trace, Compression)
+{
+    // a loop of 4 instructions: only flags and small deltas are written,
+    // so an iteration takes 9 bytes
+    const uint32 iterations = 10000;
+    {
+        Trace trace( Trace::OUTPUT_FILE, trace_file);
+        CommitTraceWriter writer( trace);
+        writer.write_header( "loop.out", 0x400000);
+        for ( uint32 i = 0; i < iterations; ++i)
+        {
+            writer.write( make_record( 0x400000, 0x8d6c0000, 12, i, true, 0x410000 + 4 * i));
+            writer.write( make_record( 0x400004, 0x256b0004, 11, 0x410000 + 4 * i + 4));
+            writer.write( make_record( 0x400008, 0x25080001, 8, i + 1));
+            writer.write( make_record( 0x40000c, 0x1509fffc, 0, 0));
+        }
+    }
+    ASSERT_LT( read_file( trace_file).size(), iterations * 10);
+    unlink( trace_file);
+}
+
+TEST( Commit_Trace, Wrong_File)
+{
+    ASSERT_EXIT( CommitTraceReader reader( "./1234567890/qwertyuiop"),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+
+    {
+        Trace trace( Trace::OUTPUT_FILE, trace_file);
+        trace << "add $t0, $t1, $t2" << '\n';
+    }
+    ASSERT_EXIT( CommitTraceReader reader( trace_file),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+    unlink( trace_file);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,293 @@
+// generic C
+#include <cstring>
+#include <unistd.h>
+
+// generic C++
+#include <vector>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// MIPT-MIPS modules
+#include <bb_engine.h>
+#include <func_sim.h>
+
+static const uint32 START_PC = 0x400000;
+static const char * checkpoint_file = "./engines_test.ckpt";
+
+// stores $t0 = 1, 2, ... to 0x10000000 by a loop of 3 instructions
+static const uint32 store_loop[] =
+{
+    0x3c101000, // lui   $s0, 0x1000
+    0x34080000, // ori   $t0, $zero, 0
+    0x34090064, // ori   $t1, $zero, 100
+    0x25080001, // loop: addiu $t0, $t0, 1
+    0xae080000, // sw    $t0, 0($s0)
+    0x1509fffd  // bne   $t0, $t1, loop
+};
+
+// loads from a shared page after the first store to it has copied the page,
+// the store block is cold: it is run at the 10th, 50th and 90th iterations
+static const uint32 cow_loop[] =
+{
+    0x3c101000, // lui   $s0, 0x1000
+    0x3c111001, // lui   $s1, 0x1001
+    0x34080000, // ori   $t0, $zero, 0
+    0x34090064, // ori   $t1, $zero, 100
+    0x340b000a, // ori   $t3, $zero, 10
+    0x340c0002, // ori   $t4, $zero, 2
+    0x8e0a0000, // loop: lw $t2, 0($s0)
+    0x25080001, // addiu $t0, $t0, 1
+    0x150b0003, // bne   $t0, $t3, skip
+    0xae2c0000, // sw    $t4, 0($s1)
+    0x3c111000, // lui   $s1, 0x1000
+    0x256b0028, // addiu $t3, $t3, 40
+    0x1509fff9, // skip: bne $t0, $t1, loop
+    0x8e0d0000  // lw    $t5, 0($s0)
+};
+
+// copies words from 0x10000000 to the next ones: $t0 = 1, 2, ... 1000
+static const uint32 copy_loop[] =
+{
+    0x3c101000, // lui   $s0, 0x1000
+    0x340903e8, // ori   $t1, $zero, 1000
+    0x8e080000, // loop: lw $t0, 0($s0)
+    0x25080001, // addiu $t0, $t0, 1
+    0xae080004, // sw    $t0, 4($s0)
+    0x26100004, // addiu $s0, $s0, 4
+    0x1509fffb  // bne   $t0, $t1, loop
+};
+
+// patches its addiu at the 5th iteration: $t3 = 5 * 1 + 5 * 0x100, then 0x100 is added
+static const uint32 self_modifying_loop[] =
+{
+    0x3c100040, // lui   $s0, 0x40
+    0x3409000a, // ori   $t1, $zero, 10
+    0x340c0005, // ori   $t4, $zero, 5
+    0x8e0a0024, // lw    $t2, 0x24($s0)
+    0x256b0001, // loop: addiu $t3, $t3, 1
+    0x25080001, // addiu $t0, $t0, 1
+    0x150c0001, // bne   $t0, $t4, skip
+    0xae0a0010, // sw    $t2, 0x10($s0)
+    0x1509fffb, // skip: bne $t0, $t1, loop
+    0x256b0100  // addiu $t3, $t3, 0x100
+};
+
+static FuncMemory* load_program( const uint32* code, size_t size)
+{
+    FuncMemory* mem = new FuncMemory( START_PC, 32, 10, 12);
+    for ( size_t i = 0; i < size; ++i)
+        mem->write( code[ i], START_PC + i * sizeof( uint32));
+    return mem;
+}
+
+// saves the program with zeroed data page as a checkpoint for BasicMIPS::run
+static void save_program( const uint32* code, size_t size)
+{
+    FuncMemory* mem = load_program( code, size);
+    mem->write( 0, 0x10000000);
+    Checkpoint::State state = Checkpoint::State();
+    state.PC = START_PC;
+    Checkpoint::save( checkpoint_file, *mem, state);
+    delete mem;
+}
+
+TEST( BB_engine, JIT_Stores_In_New_Epoch)
+{
+    FuncMemory* mem = load_program( store_loop, sizeof( store_loop) / sizeof( store_loop[ 0]));
+    RF rf;
+    InstrCache icache;
+    BBEngine engine( &rf, mem, &icache, NULL, NULL, true);
+
+    // the loop is compiled and its stores hit the TLB
+    uint32 PC = START_PC;
+    ASSERT_EQ( engine.run( PC, 3 + 3 * 50), 3u + 3 * 50);
+    ASSERT_EQ( mem->read( 0x10000000), 50u);
+
+    // stores of the next epoch are seen by it
+    uint32 epoch = mem->new_epoch();
+    ASSERT_EQ( engine.run( PC, 3 * 10), 3u * 10);
+    std::vector<uint64> pages;
+    mem->get_dirty_pages( epoch, pages);
+    ASSERT_EQ( pages, std::vector<uint64>( 1, 0x10000000));
+    ASSERT_EQ( mem->read( 0x10000000), 60u);
+
+    // a snapshot keeps its content
+    FuncMemory* snapshot = mem->snapshot();
+    ASSERT_EQ( engine.run( PC, 3 * 10), 3u * 10);
+    ASSERT_EQ( mem->read( 0x10000000), 70u);
+    ASSERT_EQ( snapshot->read( 0x10000000), 60u);
+    delete snapshot;
+    delete mem;
+}
+
+// executes instructions one by one like BasicMIPS::step
+static uint32 interpret( RF& rf, FuncMemory& mem, uint32 PC, uint32 instrs_to_run)
+{
+    for ( uint32 i = 0; i < instrs_to_run; ++i)
+    {
+        FuncInstr instr( mem.read( PC), PC);
+        rf.read_src1( instr);
+        rf.read_src2( instr);
+        instr.execute();
+        if ( instr.is_load())
+            instr.set_v_dst( mem.read( instr.get_mem_addr(), instr.get_mem_size()));
+        else if ( instr.is_store())
+            mem.write( instr.get_v_src2(), instr.get_mem_addr(), instr.get_mem_size());
+        rf.write_dst( instr);
+        PC = instr.get_new_PC();
+    }
+    return PC;
+}
+
+// runs the program by ThreadedEngine and by the interpreter, memory is filled by the caller
+static void test_threaded( FuncMemory* mem, FuncMemory* ref_mem, uint32 instrs_to_run)
+{
+    RF rf;
+    InstrCache icache;
+    ThreadedEngine engine( &rf, mem, &icache, NULL, NULL);
+    uint32 PC = START_PC;
+    ASSERT_EQ( engine.run( PC, instrs_to_run), instrs_to_run);
+
+    RF ref_rf;
+    ASSERT_EQ( PC, interpret( ref_rf, *ref_mem, START_PC, instrs_to_run));
+    for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+        ASSERT_EQ( rf.read( (RegNum)i), ref_rf.read( (RegNum)i)) << "register " << i;
+
+    std::vector<uint64> pages, ref_pages;
+    mem->get_pages( pages);
+    ref_mem->get_pages( ref_pages);
+    ASSERT_EQ( pages, ref_pages);
+    for ( size_t i = 0; i < pages.size(); ++i)
+        ASSERT_EQ( memcmp( mem->find_host_addr( pages[ i]), ref_mem->find_host_addr( pages[ i]),
+                           mem->get_page_size()), 0) << "page 0x" << std::hex << pages[ i];
+    delete mem;
+    delete ref_mem;
+}
+
+static void test_threaded( const uint32* code, size_t size, uint32 instrs_to_run)
+{
+    FuncMemory* mem = load_program( code, size);
+    FuncMemory* ref_mem = load_program( code, size);
+    mem->write( 0, 0x10000000);
+    ref_mem->write( 0, 0x10000000);
+    test_threaded( mem, ref_mem, instrs_to_run);
+}
+
+TEST( Threaded_engine, Loops)
+{
+    test_threaded( store_loop, sizeof( store_loop) / sizeof( store_loop[ 0]), 3 + 3 * 100);
+    test_threaded( copy_loop, sizeof( copy_loop) / sizeof( copy_loop[ 0]), 2 + 5 * 1000);
+
+    // stores to the shared page are made to copies of it
+    std::vector<uint8> file_page( 1 << 12, 0);
+    file_page[ 0] = 1;
+    FuncMemory* mem = load_program( cow_loop, sizeof( cow_loop) / sizeof( cow_loop[ 0]));
+    FuncMemory* ref_mem = load_program( cow_loop, sizeof( cow_loop) / sizeof( cow_loop[ 0]));
+    mem->map_shared_page( 0x10000000, &file_page[ 0]);
+    ref_mem->map_shared_page( 0x10000000, &file_page[ 0]);
+    test_threaded( mem, ref_mem, 6 + 4 * 100 + 3 * 3 + 1);
+    ASSERT_EQ( file_page[ 0], 1u);
+}
+
+TEST( Threaded_engine, Self_Modifying_Code)
+{
+    FuncMemory* mem = load_program( self_modifying_loop,
+                                    sizeof( self_modifying_loop) / sizeof( self_modifying_loop[ 0]));
+    RF rf;
+    InstrCache icache;
+    ThreadedEngine engine( &rf, mem, &icache, NULL, NULL);
+    uint32 PC = START_PC;
+    ASSERT_EQ( engine.run( PC, 4 + 4 * 10 + 1 + 1), 4u + 4 * 10 + 1 + 1);
+    ASSERT_EQ( rf.read( REG_NUM_T3), 5u * 1 + 5 * 0x100 + 0x100);
+    ASSERT_EQ( mem->read( START_PC + 0x10), self_modifying_loop[ 9]);
+    delete mem;
+
+    test_threaded( self_modifying_loop,
+                   sizeof( self_modifying_loop) / sizeof( self_modifying_loop[ 0]),
+                   4 + 4 * 10 + 1 + 1);
+}
+
+static void test_cow_loop( bool use_jit)
+{
+    FuncMemory* mem = load_program( cow_loop, sizeof( cow_loop) / sizeof( cow_loop[ 0]));
+    std::vector<uint8> file_page( mem->get_page_size(), 0);
+    file_page[ 0] = 1;
+    mem->map_shared_page( 0x10000000, &file_page[ 0]);
+    RF rf;
+    InstrCache icache;
+    BBEngine engine( &rf, mem, &icache, NULL, NULL, use_jit);
+
+    uint32 PC = START_PC;
+    ASSERT_EQ( engine.run( PC, 6 + 4 * 100 + 3 * 3 + 1), 6u + 4 * 100 + 3 * 3 + 1);
+    ASSERT_EQ( rf.read( REG_NUM_T2), 2u);
+    ASSERT_EQ( rf.read( REG_NUM_T5), 2u);
+    ASSERT_EQ( mem->read( 0x10000000), 2u);
+    ASSERT_EQ( file_page[ 0], 1u);
+    delete mem;
+}
+
+TEST( BB_engine, Loads_After_Cold_Store_Copies_Page)
+{
+    test_cow_loop( false);
+    test_cow_loop( true);
+}
+
+class RecordingConsumer : public MemAccessConsumer
+{
+    public:
+        std::vector<size_t> batches;
+        std::vector<MemAccess> accesses;
+
+        void consume( const MemAccess* batch, size_t num)
+        {
+            batches.push_back( num);
+            accesses.insert( accesses.end(), batch, batch + num);
+        }
+};
+
+static void expect_access( const MemAccess& access, uint64 PC, uint64 addr,
+                           uint32 size, MemAccessType type)
+{
+    EXPECT_EQ( access.PC, PC);
+    EXPECT_EQ( access.addr, addr);
+    EXPECT_EQ( access.size, size);
+    EXPECT_EQ( access.type, type);
+}
+
+TEST( Mem_hook, Batched_Accesses)
+{
+    save_program( copy_loop, sizeof( copy_loop) / sizeof( copy_loop[ 0]));
+    RecordingConsumer consumer;
+    {
+        BasicMIPS<BatchedMemHook> mips( ( BatchedMemHook( &consumer)));
+        Trace trace( Trace::OUTPUT_NONE);
+        mips.run( checkpoint_file, 2 + 5 * 1000, trace);
+    }
+    unlink( checkpoint_file);
+
+    // a fetch per instruction, a load and a store per iteration,
+    // the rest of the full batches is delivered at the end of run()
+    ASSERT_EQ( consumer.batches.size(), 2u);
+    ASSERT_EQ( consumer.batches[ 0], 4096u);
+    ASSERT_EQ( consumer.batches[ 1], 2u + 7 * 1000 - 4096);
+
+    const std::vector<MemAccess>& accesses = consumer.accesses;
+    expect_access( accesses[ 0], START_PC, START_PC, 4, MEM_FETCH);
+    expect_access( accesses[ 2], START_PC + 8, START_PC + 8, 4, MEM_FETCH);
+    expect_access( accesses[ 3], START_PC + 8, 0x10000000, 4, MEM_READ);
+    expect_access( accesses[ 5], START_PC + 16, START_PC + 16, 4, MEM_FETCH);
+    expect_access( accesses[ 6], START_PC + 16, 0x10000004, 4, MEM_WRITE);
+
+    // the last iteration
+    size_t last = accesses.size() - 7;
+    expect_access( accesses[ last + 1], START_PC + 8, 0x10000000 + 4 * 999, 4, MEM_READ);
+    expect_access( accesses[ last + 4], START_PC + 16, 0x10000000 + 4 * 1000, 4, MEM_WRITE);
+    expect_access( accesses[ last + 6], START_PC + 24, START_PC + 24, 4, MEM_FETCH);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,215 @@
+/*
+ * bpu.cpp - branch prediction unit of the scalar MIPS CPU simulator
+ * Copyright 2015 MIPT-MIPS
+ */
+
+/* C++ libraries. */
+#include <iomanip>
+
+/* Simulator modules. */
+#include <bpu.h>
+
+void TournamentBP::update( uint32 PC, bool is_taken)
+{
+    bool is_gshare_taken = gshare.predict( PC);
+    if ( is_gshare_taken != bimodal.predict( PC)) // train chooser on disagreement
+    {
+        chooser.update( PC >> 2, is_gshare_taken == is_taken);
+    }
+    bimodal.update( PC, is_taken);
+    gshare.update( PC, is_taken);
+}
+
+BTB::BTB( uint32 index_bits)
+    : entries( 1u << index_bits)
+    , mask( ( 1u << index_bits) - 1)
+{
+    for ( size_t i = 0; i < entries.size(); ++i)
+    {
+        entries[ i].is_valid = false;
+    }
+}
+
+void BTB::update( uint32 PC, uint32 target, Kind kind)
+{
+    Entry& entry = entries[ ( PC >> 2) & mask];
+    entry.PC = PC;
+    entry.target = target;
+    entry.kind = kind;
+    entry.is_valid = true;
+}
+
+void BTB::invalidate( uint32 PC)
+{
+    Entry& entry = entries[ ( PC >> 2) & mask];
+    if ( entry.PC == PC)
+    {
+        entry.is_valid = false;
+    }
+}
+
+void RAS::push( uint32 addr)
+{
+    stack[ top] = addr;
+    top = ( top + 1) % stack.size();
+    if ( depth < stack.size())
+    {
+        depth++;
+    }
+}
+
+void RAS::pop()
+{
+    if ( depth == 0)
+    {
+        return;
+    }
+    top = ( top + stack.size() - 1) % stack.size();
+    depth--;
+}
+
+BPU::BPU( Predictor predictor, uint32 index_bits, uint32 history_bits,
+          uint32 btb_index_bits, uint32 ras_size)
+    : predictor( predictor)
+    , btb( btb_index_bits)
+    , ras( ras_size)
+    , branches( 0)
+    , jumps( 0)
+    , target_misses( 0)
+    , return_misses( 0)
+    , mispredictions( 0)
+{
+    predictors[ PREDICTOR_STATIC] = new StaticBP;
+    predictors[ PREDICTOR_BIMODAL] = new BimodalBP( index_bits);
+    predictors[ PREDICTOR_GSHARE] = new GshareBP( index_bits, history_bits);
+    predictors[ PREDICTOR_TOURNAMENT] = new TournamentBP( index_bits, history_bits);
+    for ( int i = 0; i < PREDICTORS_NUM; ++i)
+    {
+        direction_misses[ i] = 0;
+    }
+}
+
+BPU::~BPU()
+{
+    for ( int i = 0; i < PREDICTORS_NUM; ++i)
+    {
+        delete predictors[ i];
+    }
+}
+
+uint32 BPU::predict( uint32 PC) const
+{
+    const BTB::Entry* entry = btb.find( PC);
+    if ( entry == NULL) // not a jump or not seen yet
+    {
+        return PC + 4;
+    }
+    switch ( entry->kind)
+    {
+        case BTB::KIND_BRANCH:
+            return predictors[ predictor]->predict( PC) ? entry->target : PC + 4;
+        case BTB::KIND_RETURN:
+            return ras.is_empty() ? entry->target : ras.peek();
+        default:
+            return entry->target;
+    }
+}
+
+void BPU::update( const FuncInstr& instr)
+{
+    uint32 PC = instr.get_PC();
+    uint32 target = instr.get_new_PC();
+    if ( instr.is_misprediction())
+    {
+        mispredictions++;
+    }
+    if ( !instr.isJump()) // BTB entry of other code, e.g. the code is changed
+    {
+        if ( instr.is_misprediction())
+        {
+            btb.invalidate( PC);
+        }
+        return;
+    }
+
+    bool is_taken = target != PC + 4;
+    BTB::Kind kind = BTB::KIND_JUMP;
+    if ( instr.is_branch())
+    {
+        kind = BTB::KIND_BRANCH;
+        branches++;
+        for ( int i = 0; i < PREDICTORS_NUM; ++i)
+        {
+            if ( predictors[ i]->predict( PC) != is_taken)
+            {
+                direction_misses[ i]++;
+            }
+            predictors[ i]->update( PC, is_taken);
+        }
+    } else
+    {
+        jumps++;
+        if ( instr.is_call())
+        {
+            kind = BTB::KIND_CALL;
+            ras.push( PC + 4);
+        } else if ( instr.is_return())
+        {
+            kind = BTB::KIND_RETURN;
+            if ( instr.is_misprediction())
+            {
+                return_misses++;
+            }
+            ras.pop();
+        }
+    }
+
+    /* Not taken branches are not allocated, their target is PC + 4. */
+    const BTB::Entry* entry = btb.find( PC);
+    if ( is_taken && ( entry == NULL || ( kind != BTB::KIND_RETURN && entry->target != target)))
+    {
+        target_misses++;
+    }
+    if ( is_taken || entry != NULL)
+    {
+        btb.update( PC, is_taken ? target : entry->target, kind);
+    }
+}
+
+const char* BPU::get_name( Predictor predictor)
+{
+    static const char* const names[ PREDICTORS_NUM] =
+    {
+        "static", "bimodal", "gshare", "tournament"
+    };
+    return names[ predictor];
+}
+
+static double per_kilo( uint64 events, uint64 instrs)
+{
+    return instrs != 0 ? 1000.0 * events / instrs : 0;
+}
+
+void BPU::print_stats( std::ostream& out, uint64 instrs) const
+{
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision( 2);
+    out << "branch prediction: " << get_name( predictor) << ", "
+        << mispredictions << " mispredictions, MPKI "
+        << per_kilo( mispredictions, instrs) << std::endl
+        << "conditional branches: " << branches
+        << ", directions predicted at resolution:" << std::endl;
+    for ( int i = 0; i < PREDICTORS_NUM; ++i)
+    {
+        double accuracy = branches != 0
+                          ? 100.0 * ( branches - direction_misses[ i]) / branches
+                          : 0;
+        out << ( i == predictor ? "  * " : "    ")
+            << std::left << std::setw( 12) << get_name( Predictor( i)) << std::right
+            << "accuracy " << std::setw( 6) << accuracy
+            << "%, MPKI " << per_kilo( direction_misses[ i], instrs) << std::endl;
+    }
+    out << "jumps: " << jumps << ", taken jumps and branches missing in BTB: "
+        << target_misses << ", mispredicted returns: " << return_misses << std::endl;
+    out.flags( flags);
+}
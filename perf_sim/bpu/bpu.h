@@ -0,0 +1,233 @@
+/*
+ * bpu.h - branch prediction unit of the scalar MIPS CPU simulator
+ * Copyright 2015 MIPT-MIPS
+ */
+
+/* Protection from multi-including. */
+#ifndef BPU_H
+#define BPU_H
+
+/* C++ libraries. */
+#include <iostream>
+#include <vector>
+
+/* Simulator modules. */
+#include <types.h>
+#include <func_instr.h>
+
+/* Table of 2-bit saturating counters, a counter predicts taken from 2. */
+class SaturatingCounters
+{
+    private:
+        std::vector< uint8> counters;
+        uint32 mask;
+
+    public:
+        explicit SaturatingCounters( uint32 index_bits)
+            : counters( 1u << index_bits, 1) // weakly not taken
+            , mask( ( 1u << index_bits) - 1)
+        { }
+        bool is_taken( uint32 index) const { return counters[ index & mask] >= 2; }
+        void update( uint32 index, bool is_taken)
+        {
+            uint8& counter = counters[ index & mask];
+            if ( is_taken && counter < 3)
+            {
+                counter++;
+            } else if ( !is_taken && counter > 0)
+            {
+                counter--;
+            }
+        }
+};
+
+/* Predictor of directions of conditional branches. */
+class BP
+{
+    public:
+        virtual ~BP() { }
+        /* Returns true if the branch at PC is predicted taken. */
+        virtual bool predict( uint32 PC) const = 0;
+        /* Trains the predictor by the resolved branch at PC. */
+        virtual void update( uint32 PC, bool is_taken) = 0;
+};
+
+/* Branches are never taken. */
+class StaticBP : public BP
+{
+    public:
+        bool predict( uint32 /* PC */) const { return false; }
+        void update( uint32 /* PC */, bool /* is_taken */) { }
+};
+
+/* A counter per branch, indexed by PC. */
+class BimodalBP : public BP
+{
+    private:
+        SaturatingCounters table;
+
+    public:
+        explicit BimodalBP( uint32 index_bits) : table( index_bits) { }
+        bool predict( uint32 PC) const { return table.is_taken( PC >> 2); }
+        void update( uint32 PC, bool is_taken) { table.update( PC >> 2, is_taken); }
+};
+
+/*
+ * Counters indexed by PC xor'ed with global history of branch directions.
+ * The history is updated when branches are resolved.
+ */
+class GshareBP : public BP
+{
+    private:
+        SaturatingCounters table;
+        uint32 history;
+        uint32 history_mask;
+
+        uint32 get_index( uint32 PC) const { return ( PC >> 2) ^ history; }
+
+    public:
+        GshareBP( uint32 index_bits, uint32 history_bits)
+            : table( index_bits)
+            , history( 0)
+            , history_mask( ( 1u << history_bits) - 1)
+        { }
+        bool predict( uint32 PC) const { return table.is_taken( get_index( PC)); }
+        void update( uint32 PC, bool is_taken)
+        {
+            table.update( get_index( PC), is_taken);
+            history = ( ( history << 1) | is_taken) & history_mask;
+        }
+};
+
+/* Bimodal and gshare predictors, a chooser counter per branch selects one. */
+class TournamentBP : public BP
+{
+    private:
+        BimodalBP bimodal;
+        GshareBP gshare;
+        SaturatingCounters chooser; // taken means gshare
+
+    public:
+        TournamentBP( uint32 index_bits, uint32 history_bits)
+            : bimodal( index_bits)
+            , gshare( index_bits, history_bits)
+            , chooser( index_bits)
+        { }
+        bool predict( uint32 PC) const
+        {
+            return chooser.is_taken( PC >> 2) ? gshare.predict( PC) : bimodal.predict( PC);
+        }
+        void update( uint32 PC, bool is_taken);
+};
+
+/* Direct-mapped branch target buffer. */
+class BTB
+{
+    public:
+        enum Kind
+        {
+            KIND_BRANCH, // conditional, direction is predicted
+            KIND_JUMP,
+            KIND_CALL,
+            KIND_RETURN // target is taken from return address stack
+        };
+        struct Entry
+        {
+            uint32 PC;
+            uint32 target;
+            Kind kind;
+            bool is_valid;
+        };
+
+    private:
+        std::vector< Entry> entries;
+        uint32 mask;
+
+    public:
+        explicit BTB( uint32 index_bits);
+        /* Returns NULL if there is no entry for PC. */
+        const Entry* find( uint32 PC) const
+        {
+            const Entry& entry = entries[ ( PC >> 2) & mask];
+            return entry.is_valid && entry.PC == PC ? &entry : NULL;
+        }
+        void update( uint32 PC, uint32 target, Kind kind);
+        void invalidate( uint32 PC);
+};
+
+/* Return address stack, the oldest addresses are overwritten. */
+class RAS
+{
+    private:
+        std::vector< uint32> stack;
+        uint32 top; // index of the next push
+        uint32 depth; // number of valid addresses
+
+    public:
+        explicit RAS( uint32 size) : stack( size, 0), top( 0), depth( 0) { }
+        bool is_empty() const { return depth == 0; }
+        uint32 peek() const { return stack[ ( top + stack.size() - 1) % stack.size()]; }
+        void push( uint32 addr);
+        void pop();
+};
+
+/*
+ * Predicts next PC by the PC of fetched instruction: a jump is known by its
+ * BTB entry, a conditional one is taken if its direction predictor says so.
+ * All direction predictors are trained by the same branches so their
+ * accuracy is compared in one run, the selected one is used by fetch.
+ * Everything is updated by resolved instructions, so a return fetched
+ * before the call is executed takes a wrong address.
+ */
+class BPU
+{
+    public:
+        enum Predictor
+        {
+            PREDICTOR_STATIC, // not taken
+            PREDICTOR_BIMODAL,
+            PREDICTOR_GSHARE,
+            PREDICTOR_TOURNAMENT,
+            PREDICTORS_NUM
+        };
+
+    private:
+        Predictor predictor;
+        BP* predictors[ PREDICTORS_NUM];
+        BTB btb;
+        RAS ras;
+
+        /* Statistics. */
+        uint64 branches; // conditional ones
+        uint64 direction_misses[ PREDICTORS_NUM];
+        uint64 jumps; // unconditional ones
+        uint64 target_misses; // taken jumps or branches without BTB entry
+        uint64 return_misses;
+        uint64 mispredictions; // wrong next PC, the pipeline is flushed
+
+        BPU( const BPU&); // no copies
+        BPU& operator=( const BPU&);
+
+    public:
+        /*
+         * Tables have 2^index_bits entries, gshare uses history_bits
+         * of global history.
+         */
+        explicit BPU( Predictor predictor, uint32 index_bits = 12,
+                      uint32 history_bits = 12, uint32 btb_index_bits = 9,
+                      uint32 ras_size = 16);
+        ~BPU();
+
+        /* Returns PC of the instruction to fetch after the one at PC. */
+        uint32 predict( uint32 PC) const;
+        /* Trains by the executed instruction, its predicted_PC is checked. */
+        void update( const FuncInstr& instr);
+
+        uint64 get_mispredictions() const { return mispredictions; }
+        /* Prints accuracy and MPKI of the predictors, instrs are executed. */
+        void print_stats( std::ostream& out, uint64 instrs) const;
+
+        static const char* get_name( Predictor predictor);
+};
+
+#endif // #ifndef BPU_H
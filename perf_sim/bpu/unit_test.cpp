@@ -0,0 +1,107 @@
+// Generic C++
+#include <sstream>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// MIPT-MIPS modules
+#include <bpu.h>
+
+static const uint32 BNE = 0x15090010;     // bne $t0, $t1, 0x10
+static const uint32 JAL = 0x0c100040;     // jal 0x400100
+static const uint32 JR_RA = 0x03e00008;   // jr $ra
+static const uint32 ADDU = 0x01095021;    // addu $t2, $t0, $t1
+
+// executes the instruction fetched after the prediction and trains by it
+static void resolve( BPU& bpu, FuncInstr instr)
+{
+    instr.set_predicted_PC( bpu.predict( instr.get_PC()));
+    instr.execute();
+    bpu.update( instr);
+}
+
+static FuncInstr branch( uint32 PC, bool is_taken)
+{
+    FuncInstr instr( BNE, PC);
+    instr.set_v_src1( 1);
+    instr.set_v_src2( is_taken ? 2 : 1);
+    return instr;
+}
+
+TEST( BPU, Static_Not_Taken)
+{
+    BPU bpu( BPU::PREDICTOR_STATIC);
+    ASSERT_EQ( bpu.predict( 0x400000), 0x400004u);
+    for ( int i = 0; i < 10; ++i)
+        resolve( bpu, branch( 0x400000, true));
+    ASSERT_EQ( bpu.get_mispredictions(), 10u);
+    resolve( bpu, branch( 0x400000, false));
+    ASSERT_EQ( bpu.get_mispredictions(), 10u);
+}
+
+TEST( BPU, Bimodal_Loop)
+{
+    BPU bpu( BPU::PREDICTOR_BIMODAL);
+    for ( int i = 0; i < 10; ++i)
+        resolve( bpu, branch( 0x400000, true));
+    ASSERT_EQ( bpu.get_mispredictions(), 1u); // the target is not known first
+    ASSERT_EQ( bpu.predict( 0x400000), 0x400044u);
+
+    // other instructions are fetched sequentially
+    FuncInstr instr( ADDU, 0x400004);
+    ASSERT_EQ( bpu.predict( 0x400004), 0x400008u);
+    resolve( bpu, instr);
+    ASSERT_EQ( bpu.get_mispredictions(), 1u);
+}
+
+TEST( BPU, Gshare_Pattern)
+{
+    BPU bimodal( BPU::PREDICTOR_BIMODAL);
+    BPU gshare( BPU::PREDICTOR_GSHARE);
+    BPU tournament( BPU::PREDICTOR_TOURNAMENT);
+    for ( int i = 0; i < 200; ++i)
+    {
+        resolve( bimodal, branch( 0x400000, i % 2 == 0));
+        resolve( gshare, branch( 0x400000, i % 2 == 0));
+        resolve( tournament, branch( 0x400000, i % 2 == 0));
+    }
+    ASSERT_GT( bimodal.get_mispredictions(), 90u);
+    ASSERT_LT( gshare.get_mispredictions(), 10u);
+    ASSERT_LT( tournament.get_mispredictions(), 20u);
+}
+
+TEST( BPU, Return_Address_Stack)
+{
+    BPU bpu( BPU::PREDICTOR_BIMODAL);
+    resolve( bpu, FuncInstr( JAL, 0x400000));
+    FuncInstr ret( JR_RA, 0x400100);
+    ret.set_v_src1( 0x400004);
+    resolve( bpu, ret);
+    ASSERT_EQ( bpu.get_mispredictions(), 2u);
+
+    // a call from the other place returns there
+    resolve( bpu, FuncInstr( JAL, 0x400200));
+    ASSERT_EQ( bpu.predict( 0x400200), 0x400100u);
+    ASSERT_EQ( bpu.predict( 0x400100), 0x400204u);
+    ret.set_v_src1( 0x400204);
+    resolve( bpu, ret);
+    ASSERT_EQ( bpu.get_mispredictions(), 3u);
+}
+
+TEST( BPU, Stats)
+{
+    BPU bpu( BPU::PREDICTOR_TOURNAMENT);
+    for ( int i = 0; i < 10; ++i)
+        resolve( bpu, branch( 0x400000, true));
+    std::ostringstream out;
+    bpu.print_stats( out, 100);
+    ASSERT_NE( out.str().find( "tournament, 1 mispredictions, MPKI 10.00"), std::string::npos);
+    ASSERT_NE( out.str().find( "static      accuracy   0.00%, MPKI 100.00"), std::string::npos);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -8,6 +8,7 @@
 /* Generic C. */
 #include <cstdlib>
 #include <cstring>
+#include <unistd.h>
 
 /* Simulator modules. */
 #include <perf_sim.h>
@@ -17,31 +18,140 @@ using namespace std;
 int main( int argc, char* argv[])
 {
     bool is_silent = true; // by default it's silent mode
-    switch( argc)
+    string commit_trace_file; // empty if the commit trace is not written
+    int instrs_to_skip = 0; // executed functionally before the simulation
+    FuncMemory::Backend backend = FuncMemory::BACKEND_TABLES;
+    bool print_profile = false;
+    string image_cache; // empty if ELF file is loaded directly
+    bool is_bypass = false;
+    bool print_stats = false;
+    bool is_prediction = false; // Fetch waits for jumps by default
+    BPU::Predictor predictor = BPU::PREDICTOR_STATIC;
+
+    /*
+     * Options may follow the arguments: "perf_sim mips_exe 100 -d".
+     * "-f N" executes N instructions functionally before the simulation.
+     * "-m tables|flat|flat-thp" selects guest memory backend.
+     * "-p" prints flat profile by functions to stderr.
+     * "-i dir" loads mips_exe by its preprocessed image kept in dir.
+     * "-w" forwards results by bypasses instead of waiting for writeback.
+     * "-v" prints cycles, CPI and stalls to stderr.
+     * "-j static|bimodal|gshare|tournament" fetches after jumps by
+     * branch prediction with the direction predictor.
+     */
+    int opt;
+    while ( ( opt = getopt( argc, argv, "db:f:m:pi:wvj:")) != -1)
     {
-        case 3: // check arguments (silent mode)
-            if ( ( argv[ 1] == nullptr) || ( atoi( argv[ 2]) < 0))
-            {
-                cerr << "ERROR: Wrong arguments!\n";
-                exit( EXIT_FAILURE);
-            }
-            break;
-        case 4: // check arguments (normal mode)
-            if ( ( argv[ 1] == nullptr) || ( atoi( argv[ 2]) < 0) ||
-                 ( strcmp( argv[ 3], "-d")))
-            {
+        switch ( opt)
+        {
+            case 'd': // normal mode
+                is_silent = false;
+                break;
+            case 'b': // binary trace of committed instructions
+                commit_trace_file = optarg;
+                break;
+            case 'f': // fast-forward
+                instrs_to_skip = atoi( optarg);
+                if ( instrs_to_skip < 0)
+                {
+                    cerr << "ERROR: Wrong arguments!\n";
+                    exit( EXIT_FAILURE);
+                }
+                break;
+            case 'm': // memory backend
+                if ( !strcmp( optarg, "tables"))
+                {
+                    backend = FuncMemory::BACKEND_TABLES;
+                } else if ( !strcmp( optarg, "flat"))
+                {
+                    backend = FuncMemory::BACKEND_FLAT;
+                } else if ( !strcmp( optarg, "flat-thp"))
+                {
+                    backend = FuncMemory::BACKEND_FLAT_THP;
+                } else
+                {
+                    cerr << "ERROR: Wrong arguments!\n";
+                    exit( EXIT_FAILURE);
+                }
+                break;
+            case 'p': // profile
+                print_profile = true;
+                break;
+            case 'i': // sim image cache
+                image_cache = optarg;
+                break;
+            case 'w': // bypass network
+                is_bypass = true;
+                break;
+            case 'v': // statistics
+                print_stats = true;
+                break;
+            case 'j': // branch prediction
+                is_prediction = true;
+                if ( !strcmp( optarg, "static"))
+                {
+                    predictor = BPU::PREDICTOR_STATIC;
+                } else if ( !strcmp( optarg, "bimodal"))
+                {
+                    predictor = BPU::PREDICTOR_BIMODAL;
+                } else if ( !strcmp( optarg, "gshare"))
+                {
+                    predictor = BPU::PREDICTOR_GSHARE;
+                } else if ( !strcmp( optarg, "tournament"))
+                {
+                    predictor = BPU::PREDICTOR_TOURNAMENT;
+                } else
+                {
+                    cerr << "ERROR: Wrong arguments!\n";
+                    exit( EXIT_FAILURE);
+                }
+                break;
+            default:
                 cerr << "ERROR: Wrong arguments!\n";
                 exit( EXIT_FAILURE);
-            }
-            is_silent = false; // disable silent mode
-            break;
-        default: // wrong number of arguments
-            cerr << "ERROR: Wrong number of arguments!\n";
-            exit( EXIT_FAILURE);
+        }
+    }
+
+    if ( argc - optind != 2) // wrong number of arguments
+    {
+        cerr << "ERROR: Wrong number of arguments!\n";
+        exit( EXIT_FAILURE);
+    }
+    if ( atoi( argv[ optind + 1]) < 0) // check arguments
+    {
+        cerr << "ERROR: Wrong arguments!\n";
+        exit( EXIT_FAILURE);
     }
 
+    Trace commit_trace_out( commit_trace_file.empty() ? Trace::OUTPUT_NONE
+                                                      : Trace::OUTPUT_FILE,
+                            commit_trace_file);
+    CommitTraceWriter commit_trace( commit_trace_out);
+
     PerfMIPS* p_mips = new PerfMIPS;
-    p_mips->run( argv[ 1], atoi( argv[ 2]), is_silent);
+    if ( print_profile)
+    {
+        p_mips->enable_profile();
+    }
+    if ( !image_cache.empty())
+    {
+        p_mips->set_image_cache( image_cache);
+    }
+    if ( is_bypass)
+    {
+        p_mips->enable_bypass();
+    }
+    if ( print_stats)
+    {
+        p_mips->enable_stats();
+    }
+    if ( is_prediction)
+    {
+        p_mips->enable_branch_prediction( predictor);
+    }
+    p_mips->run( argv[ optind], atoi( argv[ optind + 1]), is_silent,
+                 commit_trace_file.empty() ? nullptr : &commit_trace, instrs_to_skip,
+                 backend);
     delete p_mips;
     return 0;
 }
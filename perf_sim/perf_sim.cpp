@@ -10,38 +10,52 @@
 
 /* Simulator modules. */
 #include <perf_sim.h>
+#include <func_sim.h>
 
 /* Ports constants. */
 #define PORT_BW 1
 #define PORT_FANOUT 1
 #define PORT_LATENCY 1
 
-PerfMIPS::PerfMIPS()
+template <typename Hook>
+BasicPerfMIPS< Hook>::BasicPerfMIPS( const Hook& hook) : hook( hook)
 {
     /* Zero module storages. */
-    uint32 fetch_data = 0;
-    uint32 decode_data = 0;
+    fetch_data.bytes = 0;
+    fetch_data.PC = 0;
+    fetch_data.predicted_PC = 0;
+    fetch_data.is_mapped = false;
 
     PC_is_valid = false; // PC unset
-    decode_stall = true; // prevent generating "nop" on Decode
+    print_profile = false;
+    profile = NULL;
+    text.addr = 0;
+    text.size = 0;
+    text.instrs = NULL;
+    text.is_valid = NULL;
     /* Reset data dependency components. */
-    source_stall_data = 0;
-    source_stall = false;
-    source_stall_end = false;
+    source_stalls = 0;
+    /* Interlocks only, see enable_bypass(). */
+    is_bypass = false;
+    load_dst = REG_NUM_ZERO;
+    execute_valid = false;
+    memory_valid = false;
+    bpu = NULL; // Fetch waits for jumps
+    print_stats = false;
 
-    rf = new RF; // create register file
+    rf = new PerfRF; // create register file
 
     /* Create data ports. */
-    wp_fetch_2_decode = new WritePort< uint32>( "FETCH_2_DECODE",
-                                                PORT_BW,
-                                                PORT_FANOUT);
-    rp_fetch_2_decode = new ReadPort< uint32>( "FETCH_2_DECODE",
-                                               PORT_LATENCY);
-    wp_decode_2_execute = new WritePort< FuncInstr>( "DECODE_2_EXECUTE",
-                                                  PORT_BW,
-                                                  PORT_FANOUT);
-    rp_decode_2_execute = new ReadPort< FuncInstr>( "DECODE_2_EXECUTE",
-                                                 PORT_LATENCY);
+    wp_fetch_2_decode = new WritePort< FetchData>( "FETCH_2_DECODE",
+                                                   PORT_BW,
+                                                   PORT_FANOUT);
+    rp_fetch_2_decode = new ReadPort< FetchData>( "FETCH_2_DECODE",
+                                                  PORT_LATENCY);
+    wp_decode_2_execute = new WritePort< DecodeData>( "DECODE_2_EXECUTE",
+                                                      PORT_BW,
+                                                      PORT_FANOUT);
+    rp_decode_2_execute = new ReadPort< DecodeData>( "DECODE_2_EXECUTE",
+                                                     PORT_LATENCY);
     wp_execute_2_memory = new WritePort< FuncInstr>( "EXECUTE_2_MEMORY",
                                                   PORT_BW,
                                                   PORT_FANOUT);
@@ -75,13 +89,26 @@ PerfMIPS::PerfMIPS()
     rp_writeback_2_memory_stall = new ReadPort< bool>( "WRITEBACK_2_MEMORY_STALL",
                                                        PORT_LATENCY);
 
+    /* Create misprediction ports, flush is read by Decode and Execute. */
+    wp_execute_2_fetch_target = new WritePort< uint32>( "EXECUTE_2_FETCH_TARGET",
+                                                        PORT_BW,
+                                                        PORT_FANOUT);
+    rp_execute_2_fetch_target = new ReadPort< uint32>( "EXECUTE_2_FETCH_TARGET",
+                                                       PORT_LATENCY);
+    wp_execute_flush = new WritePort< bool>( "EXECUTE_FLUSH", PORT_BW, 2);
+    rp_decode_flush = new ReadPort< bool>( "EXECUTE_FLUSH", PORT_LATENCY);
+    rp_execute_flush = new ReadPort< bool>( "EXECUTE_FLUSH", PORT_LATENCY);
+
     /* Initialize all types of ports. */
+    Port< FetchData>::init();
+    Port< DecodeData>::init();
     Port< uint32>::init();
     Port< FuncInstr>::init();
     Port< bool>::init();
 }
 
-PerfMIPS::~PerfMIPS()
+template <typename Hook>
+BasicPerfMIPS< Hook>::~BasicPerfMIPS()
 {
     delete rf;
 
@@ -103,36 +130,146 @@ PerfMIPS::~PerfMIPS()
     delete wp_memory_2_execute_stall;
     delete rp_writeback_2_memory_stall;
     delete wp_writeback_2_memory_stall;
+
+    delete rp_execute_2_fetch_target;
+    delete wp_execute_2_fetch_target;
+    delete wp_execute_flush;
+    delete rp_decode_flush;
+    delete rp_execute_flush;
+
+    delete bpu;
 }
 
-void PerfMIPS::run( const string& tr, int instrs_to_run, bool is_silent)
+template <typename Hook>
+void BasicPerfMIPS< Hook>::enable_branch_prediction( BPU::Predictor predictor)
 {
-    mem = new FuncMemory( tr.c_str()); // create functional memory
+    delete bpu;
+    bpu = new BPU( predictor);
+}
+
+template <typename Hook>
+void BasicPerfMIPS< Hook>::fast_forward( int instrs_to_skip)
+{
+    if ( instrs_to_skip <= 0)
+    {
+        return;
+    }
+
+    /* Functional simulator runs on the same memory by its fastest engine. */
+    Checkpoint::State state = Checkpoint::State();
+    state.PC = PC;
+    for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+    {
+        state.reg[ i] = rf->read( ( RegNum)i);
+    }
+    BasicMIPS< Hook> func_sim( hook);
+    func_sim.run( mem, state, instrs_to_skip,
+                  Hook::ENABLED ? MIPSEngine::ENGINE_INTERP : MIPSEngine::ENGINE_JIT);
+
+    PC = state.PC;
+    for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+    {
+        rf->write( ( RegNum)i, state.reg[ i]);
+    }
+}
+
+template <typename Hook>
+void BasicPerfMIPS< Hook>::run( const string& tr, int instrs_to_run, bool is_silent,
+                                 CommitTraceWriter* commit_trace, int instrs_to_skip,
+                                 FuncMemory::Backend backend)
+{
+    if ( Checkpoint::is_checkpoint( tr)) // restore saved state
+    {
+        Checkpoint::State state;
+        mem = Checkpoint::load( tr, state, backend);
+        for ( size_t i = 0; i < REG_NUM_MAX; ++i)
+        {
+            rf->write( ( RegNum)i, state.reg[ i]);
+        }
+    } else if ( !image_cache.empty()) // map preprocessed image
+    {
+        mem = SimImage::load( tr, image_cache, text, backend);
+    } else
+    {
+        mem = new FuncMemory( tr.c_str(), 32, 10, 12, backend); // create functional memory
+    }
     PC = mem->startPC(); // get starting programm address
+    fast_forward( instrs_to_skip); // pipeline starts with the state reached
     PC_is_valid = true; // now PC is valid
     this->is_silent = is_silent; // set mode
+    trace = is_silent ? new Trace : NULL;
+    this->commit_trace = commit_trace;
+    if ( commit_trace != NULL)
+    {
+        commit_trace->write_header( tr, PC);
+    }
+    if ( print_profile)
+    {
+        profile = new Profile( Checkpoint::elf_file_name( tr));
+    }
+    decode_PC = PC;
     executed_instrs = 0;
     int cycle = 0;
     while ( executed_instrs < instrs_to_run) // main loop
     {
+        int retired_instrs = executed_instrs;
         clockFetch( cycle);
         clockDecode( cycle);
         clockExecute( cycle);
         clockMemory( cycle);
         clockWriteback( cycle);
+        if ( profile != NULL)
+        {
+            if ( executed_instrs != retired_instrs)
+            {
+                profile->count_instr( writeback_data.get_PC());
+                profile->count_cycle( writeback_data.get_PC(), false);
+            } else
+            {
+                profile->count_cycle( decode_PC, true);
+            }
+        }
         ++cycle;
         if ( !is_silent)
         {
             cout << "Executed instructions: " << executed_instrs << endl << endl;
         }
     }
+    hook.flush();
+    if ( print_stats)
+    {
+        cerr << "cycles: " << cycle << ", instructions: " << executed_instrs
+             << ", CPI: " << double( cycle) / executed_instrs << endl
+             << "cycles of Decode waiting for sources: " << source_stalls
+             << ( is_bypass ? " (load-use with bypasses)" : " (interlocks only)")
+             << endl;
+        if ( bpu != NULL)
+        {
+            bpu->print_stats( cerr, executed_instrs);
+        }
+    }
+    if ( profile != NULL)
+    {
+        profile->print( cerr);
+    }
+    delete profile;
+    profile = NULL;
+    delete trace;
 }
 
 
-void PerfMIPS::clockFetch( int cycle)
+template <typename Hook>
+void BasicPerfMIPS< Hook>::clockFetch( int cycle)
 {
     bool is_stall = false;
     rp_decode_2_fetch_stall->read( &is_stall, cycle);
+    uint32 target = 0;
+    if ( rp_execute_2_fetch_target->read( &target, cycle)) // jump is executed
+    {
+        PC = target;
+        PC_is_valid = true;
+        is_stall = false; // Decode is flushed
+    }
     if ( is_stall) // if stall
     {
         if ( !is_silent)
@@ -150,36 +287,67 @@ void PerfMIPS::clockFetch( int cycle)
         return;
     }
     /* Process data. */
-    fetch_data = fetch();
-    if ( isJump( fetch_data)) // if jump or branch - make stall
+    fetch_data.PC = PC;
+    fetch_data.is_mapped = mem->check( PC);
+    if ( !fetch_data.is_mapped) // wait for a jump back, e.g. from the wrong path
     {
+        fetch_data.bytes = 0;
+        fetch_data.predicted_PC = PC + 4;
         PC_is_valid = false;
+        wp_fetch_2_decode->write( fetch_data, cycle);
+        if ( !is_silent)
+        {
+            cout << "    fetch\tcycle " << cycle << ":  unmapped 0x" << hex << PC
+                 << dec << endl;
+        }
+        return;
+    }
+    fetch_data.bytes = fetch();
+    if ( bpu != NULL) // go on from the predicted address
+    {
+        fetch_data.predicted_PC = bpu->predict( PC);
+    } else
+    {
+        fetch_data.predicted_PC = PC + 4;
+        if ( isJump( fetch_data.bytes)) // if jump or branch - make stall
+        {
+            PC_is_valid = false;
+        }
     }
+    PC = fetch_data.predicted_PC; // update PC
     wp_fetch_2_decode->write( fetch_data, cycle); // promote data
     if ( !is_silent)
     {
-        cout << "    fetch\tcycle " << cycle << ":  0x" << hex << fetch_data
+        cout << "    fetch\tcycle " << cycle << ":  0x" << hex << fetch_data.bytes
              << dec << endl;
     }
 }
 
-void PerfMIPS::clockDecode( int cycle)
+template <typename Hook>
+void BasicPerfMIPS< Hook>::clockDecode( int cycle)
 {
-    if ( decode_stall) // prevent generating "nop" on Decode
+    RegNum prev_load_dst = load_dst; // the load is in Execute now
+    load_dst = REG_NUM_ZERO;
+
+    /* Fetch stops a cycle after stall, so the data is queued. */
+    FetchData fetch_result;
+    if ( rp_fetch_2_decode->read( &fetch_result, cycle))
     {
-        decode_stall = false;
-        if ( PC_is_valid) // update PC
-        {
-            PC += 4;
-        }
+        decode_data.push( fetch_result);
+    }
+    bool is_flush = false;
+    rp_decode_flush->read( &is_flush, cycle);
+    bool is_stall = false;
+    rp_execute_2_decode_stall->read( &is_stall, cycle);
+    if ( is_flush) // instructions fetched after mispredicted one
+    {
+        decode_data = std::queue< FetchData>();
         if ( !is_silent)
         {
             cout << "    decode\tcycle " << cycle << ":  bubble" << endl;
         }
         return;
     }
-    bool is_stall = false;
-    rp_execute_2_decode_stall->read( &is_stall, cycle);
     if ( is_stall) // if stall
     {
         if ( !is_silent)
@@ -189,37 +357,38 @@ void PerfMIPS::clockDecode( int cycle)
         wp_decode_2_fetch_stall->write( true, cycle); // promote stall
         return;
     }
-    bool read = true; // flag: will data read or not
-    if ( source_stall) // if it's stall now, use additional storage
-    {
-        rp_fetch_2_decode->read( &source_stall_data, cycle);
-    }
-    if ( !source_stall_end) // normal read
-    {
-        read = rp_fetch_2_decode->read( &decode_data, cycle);
-    } else // if it was stall, load data
-    {
-        decode_data = source_stall_data;
-        source_stall_end = false;
-    }
-    /* Process data. */
-    FuncInstr decode_data_( decode_data, PC);
-    if ( !read && decode_data_.isJump()) // if it's control dependency
+    if ( decode_data.empty()) // nothing to decode
     {
-        if ( PC_is_valid) // update PC
-        {
-            PC += 4;
-        }
         if ( !is_silent)
         {
             cout << "    decode\tcycle " << cycle << ":  bubble" << endl;
         }
         return;
     }
-    if ( !rf->check( decode_data_.get_src1_num()) || // check data dependencies
-         !rf->check( decode_data_.get_src2_num()))
+    /* Process data. */
+    const FetchData& fetched = decode_data.front();
+    DecodeData data;
+    data.fetched = fetched;
+    data.is_valid = fetched.is_mapped && FuncInstr::is_known( fetched.bytes);
+    data.instr = data.is_valid ? decode( fetched.bytes, fetched.PC)
+                               : FuncInstr( 0, fetched.PC); // nop with no sources
+    FuncInstr& instr = data.instr;
+    instr.set_predicted_PC( fetched.predicted_PC);
+    decode_PC = instr.get_PC();
+    bool is_ready; // check data dependencies
+    if ( is_bypass) // loaded data is forwarded from Memory only
+    {
+        is_ready = prev_load_dst == REG_NUM_ZERO ||
+                   ( instr.get_src1_num() != prev_load_dst &&
+                     instr.get_src2_num() != prev_load_dst);
+    } else
+    {
+        is_ready = rf->check( instr.get_src1_num()) &&
+                   rf->check( instr.get_src2_num());
+    }
+    if ( !is_ready)
     {
-        source_stall = true; // it's stall
+        source_stalls++;
         wp_decode_2_fetch_stall->write( true, cycle); // make stall
         if ( !is_silent)
         {
@@ -227,23 +396,25 @@ void PerfMIPS::clockDecode( int cycle)
         }
         return;
     }
-    if ( source_stall) // if stall was ended, next time load data from storage
+    read_src( instr);
+    rf->invalidate( instr.get_dst_num());
+    if ( instr.is_load())
     {
-        source_stall = false;
-        source_stall_end = true;
+        load_dst = instr.get_dst_num();
     }
-    read_src( decode_data_);
-    rf->invalidate( decode_data_.get_dst_num());
-    wp_decode_2_execute->write( decode_data_, cycle); // promote data
-    PC += 4; // update PC
+    wp_decode_2_execute->write( data, cycle); // promote data
+    decode_data.pop();
     if ( !is_silent)
     {
-        cout << "    decode\tcycle " << cycle << ":  " << decode_data_ << endl;
+        cout << "    decode\tcycle " << cycle << ":  " << instr << endl;
     }
 }
 
-void PerfMIPS::clockExecute( int cycle)
+template <typename Hook>
+void BasicPerfMIPS< Hook>::clockExecute( int cycle)
 {
+    bool is_flush = false;
+    rp_execute_flush->read( &is_flush, cycle);
     bool is_stall = false;
     rp_memory_2_execute_stall->read( &is_stall, cycle);
     if ( is_stall) // if stall
@@ -253,23 +424,52 @@ void PerfMIPS::clockExecute( int cycle)
             cout << "    execute\tcycle " << cycle << ":  bubble" << endl;
         }
         wp_execute_2_decode_stall->write( true, cycle); // promote stall
+        execute_valid = false;
         return;
     }
-    if ( !rp_decode_2_execute->read( &execute_data, cycle)) // nothing to read
+    DecodeData data;
+    if ( !rp_decode_2_execute->read( &data, cycle)) // nothing to read
     {
         if ( !is_silent)
         {
             cout << "    execute\tcycle " << cycle << ":  bubble" << endl;
         }
+        execute_valid = false;
         return;
     }
+    FuncInstr& instr = data.instr;
+    if ( is_flush) // decoded after mispredicted instruction
+    {
+        rf->cancel( instr.get_dst_num());
+        if ( !is_silent)
+        {
+            cout << "    execute\tcycle " << cycle << ":  bubble" << endl;
+        }
+        execute_valid = false;
+        return;
+    }
+    if ( !data.is_valid) // all older jumps are executed, so it is on the right path
+    {
+        report_invalid( data.fetched);
+    }
+    if ( is_bypass) // previous results are still in Execute and Memory
+    {
+        read_bypassed( instr);
+    }
+    execute_data = instr;
+    execute_valid = true;
     /* Process data. */
     execute_data.execute();
     wp_execute_2_memory->write( execute_data, cycle); // promote data
-    if ( execute_data.isJump()) // update PC
+    if ( bpu != NULL)
     {
-        PC = execute_data.get_new_PC();
-        PC_is_valid = true;
+        bpu->update( execute_data);
+    }
+    if ( execute_data.is_misprediction() || ( bpu == NULL && execute_data.isJump()))
+    {
+        /* Fetch goes on from the right address, younger instructions are flushed. */
+        wp_execute_2_fetch_target->write( execute_data.get_new_PC(), cycle);
+        wp_execute_flush->write( true, cycle);
     }
     if ( !is_silent)
     {
@@ -277,7 +477,8 @@ void PerfMIPS::clockExecute( int cycle)
     }
 }
 
-void PerfMIPS::clockMemory( int cycle)
+template <typename Hook>
+void BasicPerfMIPS< Hook>::clockMemory( int cycle)
 {
     bool is_stall = false;
     rp_writeback_2_memory_stall->read( &is_stall, cycle);
@@ -288,6 +489,7 @@ void PerfMIPS::clockMemory( int cycle)
             cout << "    memory\tcycle " << cycle << ":  bubble" << endl;
         }
         wp_memory_2_execute_stall->write( true, cycle); // promote stall
+        memory_valid = false;
         return;
     }
     if ( !rp_execute_2_memory->read( &memory_data, cycle)) // nothing to read
@@ -296,10 +498,12 @@ void PerfMIPS::clockMemory( int cycle)
         {
             cout << "    memory\tcycle " << cycle << ":  bubble" << endl;
         }
+        memory_valid = false;
         return;
     }
     /* Process data. */
     load_store( memory_data);
+    memory_valid = true;
     wp_memory_2_writeback->write( memory_data, cycle); // promote data
     if ( !is_silent)
     {
@@ -307,7 +511,8 @@ void PerfMIPS::clockMemory( int cycle)
     }
 }
 
-void PerfMIPS::clockWriteback( int cycle)
+template <typename Hook>
+void BasicPerfMIPS< Hook>::clockWriteback( int cycle)
 {
     if ( !rp_memory_2_writeback->read( &writeback_data, cycle)) // nothing to read
     {
@@ -325,12 +530,58 @@ void PerfMIPS::clockWriteback( int cycle)
         cout << "    writeback\tcycle " << cycle << ":  " << writeback_data << endl;
     } else
     {
-        cout << writeback_data << endl;
+        *trace << writeback_data << '\n';
+    }
+    if ( commit_trace != NULL)
+    {
+        bool is_mem = writeback_data.is_load() || writeback_data.is_store();
+        CommitRecord record = { writeback_data.get_PC(), writeback_data.get_bytes(),
+                                uint8( writeback_data.get_dst_num()),
+                                writeback_data.get_v_dst(),
+                                is_mem, writeback_data.get_mem_addr() };
+        commit_trace->write( record);
+    }
+}
+
+/* Takes source of instr written by producer. */
+static void forward( FuncInstr& instr, const FuncInstr& producer)
+{
+    RegNum dst = producer.get_dst_num();
+    if ( dst == REG_NUM_ZERO) // nothing is written
+    {
+        return;
+    }
+    if ( instr.get_src1_num() == dst)
+    {
+        instr.set_v_src1( producer.get_v_dst());
+    }
+    if ( instr.get_src2_num() == dst)
+    {
+        instr.set_v_src2( producer.get_v_dst());
     }
 }
 
+template <typename Hook>
+void BasicPerfMIPS< Hook>::read_bypassed( FuncInstr& instr) const
+{
+    /*
+     * Instructions older than instr left Writeback by now, except those
+     * which left Execute and Memory in the last cycle. The younger one
+     * is forwarded last as it writes the latest value.
+     */
+    read_src( instr);
+    if ( memory_valid)
+    {
+        forward( instr, memory_data);
+    }
+    if ( execute_valid) // it is not a load, Decode waits for them
+    {
+        forward( instr, execute_data);
+    }
+}
 
-bool PerfMIPS::isJump( uint32 data)
+template <typename Hook>
+bool BasicPerfMIPS< Hook>::isJump( uint32 data)
 {
     union // storage for data
     {
@@ -346,11 +597,14 @@ bool PerfMIPS::isJump( uint32 data)
     switch( instr.bit.opcode)
     {
         case 0x2: // j
+        case 0x3: // jal
         case 0x4: // beq
         case 0x5: // bne
+        case 0x6: // blez
+        case 0x7: // bgtz
             return true;
         case 0x0: // R-type
-            if ( instr.bit.funct == 0x8) // jr
+            if ( instr.bit.funct == 0x8 || instr.bit.funct == 0x9) // jr, jalr
             {
                 return true;
             }
@@ -358,3 +612,19 @@ bool PerfMIPS::isJump( uint32 data)
             return false;
     }
 }
+
+template <typename Hook>
+void BasicPerfMIPS< Hook>::report_invalid( const FetchData& fetched) const
+{
+    if ( !fetched.is_mapped)
+    {
+        cerr << "ERROR: Instruction is fetched from unmapped address 0x" << hex
+             << fetched.PC << dec << endl;
+        exit( EXIT_FAILURE);
+    }
+    FuncInstr( fetched.bytes, fetched.PC); // prints the word and exits as func_sim does
+}
+
+/* Simulators available to the other modules. */
+template class BasicPerfMIPS< NoMemHook>;
+template class BasicPerfMIPS< BatchedMemHook>;
@@ -9,31 +9,71 @@
 #ifndef PERF_SIM_H
 #define PERF_SIM_H
 
+/* C++ libraries. */
+#include <queue>
+
 /* Simulator modules. */
 #include <func_memory.h>
 #include <perf_sim_rf.h>
 #include <ports.h>
+#include <trace.h>
+#include <commit_trace.h>
+#include <checkpoint.h>
+#include <mem_hook.h>
+#include <profile.h>
+#include <sim_image.h>
+#include <bpu.h>
+
+/* Instruction word passed from Fetch to Decode. */
+struct FetchData
+{
+    uint32 bytes;
+    uint32 PC;
+    uint32 predicted_PC; // fetched next
+    bool is_mapped; // otherwise PC is out of memory and bytes are not read
+};
+
+/*
+ * Instruction passed from Decode to Execute. A word which is not
+ * an instruction or is not fetched is passed as a nop, it is an error
+ * only if it is executed, not flushed as fetched on the wrong path.
+ */
+struct DecodeData
+{
+    FuncInstr instr;
+    bool is_valid;
+    FetchData fetched; // reported if it is not valid
+};
 
-class PerfMIPS
+/* Hook is a policy observing memory accesses, see mem_hook.h. */
+template <typename Hook>
+class BasicPerfMIPS
 {
     private:
         /** Functional simulator components. */
-        RF* rf;
+        PerfRF* rf;
         uint32 PC;
         FuncMemory* mem;
+        Hook hook;
 
-        uint32 fetch() const { return mem->read( PC); }
+        uint32 fetch()
+        {
+            hook.access( PC, PC, sizeof( uint32), MEM_FETCH);
+            return mem->read( PC);
+        }
         void read_src( FuncInstr& instr) const
         {
             rf->read_src1( instr);
             rf->read_src2( instr);
         }
-        void load( FuncInstr& instr) const
+        void load( FuncInstr& instr)
         {
+            hook.access( instr.get_PC(), instr.get_mem_addr(), instr.get_mem_size(), MEM_READ);
             instr.set_v_dst( mem->read( instr.get_mem_addr(), instr.get_mem_size()));
         }
         void store( const FuncInstr& instr)
         {
+            hook.access( instr.get_PC(), instr.get_mem_addr(), instr.get_mem_size(), MEM_WRITE);
             mem->write( instr.get_v_src2(), instr.get_mem_addr(), instr.get_mem_size());
         }
         void load_store( FuncInstr& instr)
@@ -47,14 +87,31 @@ class PerfMIPS
             }
         }
         void wb( const FuncInstr& instr) { rf->write_dst( instr); }
+        /*
+         * Takes the predecoded instruction of the sim image if there is
+         * one for PC. Its bytes are compared as the code may be changed.
+         */
+        FuncInstr decode( uint32 bytes, uint32 PC) const
+        {
+            uint32 offset = PC - text.addr;
+            uint32 index = offset / sizeof( uint32);
+            if ( offset < text.size * sizeof( uint32) && offset % sizeof( uint32) == 0 &&
+                 text.is_valid[ index] && text.instrs[ index].get_bytes() == bytes)
+            {
+                return text.instrs[ index];
+            }
+            return FuncInstr( bytes, PC);
+        }
+        /* Executes instructions by func_sim without pipeline modeling. */
+        void fast_forward( int instrs_to_skip);
 
 
         /** Performance simulator components. */
         /* Data ports. */
-        ReadPort< uint32>* rp_fetch_2_decode;
-        WritePort< uint32>* wp_fetch_2_decode;
-        ReadPort< FuncInstr>* rp_decode_2_execute;
-        WritePort< FuncInstr>* wp_decode_2_execute;
+        ReadPort< FetchData>* rp_fetch_2_decode;
+        WritePort< FetchData>* wp_fetch_2_decode;
+        ReadPort< DecodeData>* rp_decode_2_execute;
+        WritePort< DecodeData>* wp_decode_2_execute;
         ReadPort< FuncInstr>* rp_execute_2_memory;
         WritePort< FuncInstr>* wp_execute_2_memory;
         ReadPort< FuncInstr>* rp_memory_2_writeback;
@@ -70,23 +127,46 @@ class PerfMIPS
         ReadPort< bool>* rp_writeback_2_memory_stall;
         WritePort< bool>* wp_writeback_2_memory_stall;
 
+        /* Redirection of Fetch by mispredicted instructions. */
+        ReadPort< uint32>* rp_execute_2_fetch_target;
+        WritePort< uint32>* wp_execute_2_fetch_target;
+        /* Flush of younger instructions in Decode and on the way to Execute. */
+        WritePort< bool>* wp_execute_flush;
+        ReadPort< bool>* rp_decode_flush;
+        ReadPort< bool>* rp_execute_flush;
+
         int executed_instrs; // executed instructions counter
         bool is_silent; // mode flag
+        Trace* trace; // output of executed instructions in silent mode
+        CommitTraceWriter* commit_trace; // NULL if no commit trace is written
+        bool print_profile;
+        Profile* profile; // NULL if the simulation is not profiled
+        uint32 decode_PC; // PC of the instruction in Decode, it is charged with stalls
+        string image_cache; // empty if ELF files are loaded directly
+        SimImage::Text text; // code of the sim image, empty without it
 
         /* Here modules stores data. */
-        uint32 fetch_data;
-        uint32 decode_data;
+        FetchData fetch_data;
+        std::queue< FetchData> decode_data; // the first one is decoded, others came during stall
         FuncInstr execute_data;
         FuncInstr memory_data;
         FuncInstr writeback_data;
 
-        bool PC_is_valid; // validate flag of PC
+        bool PC_is_valid; // validate flag of PC, Fetch waits for jumps without BPU
 
         /* Components for handling data dependency. */
-        uint32 source_stall_data; // storage for data came from Fetch
-        bool source_stall; // is stall flag: wait for sources
-        bool source_stall_end; // stall ended: decode came from Fetch data
-        bool decode_stall; // on start, Decode can generate "nop", prevent it
+        int source_stalls; // cycles Decode waited for sources
+
+        /* Bypass network: results are forwarded to Execute. */
+        bool is_bypass; // otherwise sources are waited in register file
+        RegNum load_dst; // destination of the load decoded in the last cycle
+        bool execute_valid; // execute_data was executed in the last cycle
+        bool memory_valid; // memory_data was processed in the last cycle
+        void read_bypassed( FuncInstr& instr) const;
+
+        BPU* bpu; // NULL if Fetch waits for jumps to be executed
+
+        bool print_stats;
 
         /* Main methods of each modules. */
         void clockFetch( int cycle);
@@ -97,12 +177,44 @@ class PerfMIPS
 
         /* Checks instruction could it change PC unusually. */
         bool isJump( uint32 data);
+        /* Prints why the fetched word can't be executed and exits. */
+        void report_invalid( const FetchData& fetched) const;
 
     public:
-        PerfMIPS();
-        ~PerfMIPS();
-        /* Starts simulator. */
-        void run( const string& tr, int instr_to_run, bool is_silent);
+        explicit BasicPerfMIPS( const Hook& hook = Hook());
+        ~BasicPerfMIPS();
+        /*
+         * Makes run() print a flat profile of instructions, cycles and
+         * stalls by functions to stderr at the end. A cycle is charged to
+         * the instruction retired in it, or to the one in Decode if none is.
+         */
+        void enable_profile() { print_profile = true; }
+        /*
+         * Makes Decode pass instructions with sources not written back yet,
+         * they are forwarded to Execute from Execute and Memory outputs.
+         * Only an instruction using result of the previous load waits.
+         */
+        void enable_bypass() { is_bypass = true; }
+        /* Makes run() print cycles, CPI and stalls to stderr at the end. */
+        void enable_stats() { print_stats = true; }
+        /*
+         * Makes Fetch go on after jumps to addresses predicted by BPU
+         * with the direction predictor. Younger instructions are flushed
+         * if a jump is executed with other target.
+         */
+        void enable_branch_prediction( BPU::Predictor predictor);
+        /* Makes run() load ELF files by sim images kept in the directory. */
+        void set_image_cache( const string& dir) { image_cache = dir; }
+        /*
+         * Starts simulator. The first instrs_to_skip instructions are
+         * executed functionally, then instr_to_run are simulated in detail.
+         * tr is ELF file or checkpoint saved by func_sim.
+         */
+        void run( const string& tr, int instr_to_run, bool is_silent,
+                  CommitTraceWriter* commit_trace = NULL, int instrs_to_skip = 0,
+                  FuncMemory::Backend backend = FuncMemory::BACKEND_TABLES);
 };
 
+typedef BasicPerfMIPS< NoMemHook> PerfMIPS;
+
 #endif // #ifndef PERF_SIM_H
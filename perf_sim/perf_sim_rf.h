@@ -12,15 +12,15 @@
 /* Simulator modules. */
 #include <func_instr.h>
 
-class RF
+class PerfRF
 {
     private:
         /* Array of registers. */
         struct Reg
         {
             uint32 value;
-            bool is_valid;
-            Reg() : value( 0ull), is_valid( true) {}
+            uint32 writers; // instructions in flight which write it
+            Reg() : value( 0ull), writers( 0) {}
         } array [ REG_NUM_MAX];
 
     public:
@@ -33,9 +33,12 @@ class RF
                 cerr << "ERROR: Wrong register number!\n";
                 exit( EXIT_FAILURE);
             }
-            return array[ num].is_valid;
+            return array[ num].writers == 0;
         }
-        /* Makes register invalid. It cannot be used as source. */
+        /*
+         * Makes register invalid until the instruction writes it. With
+         * bypasses several writers of one register may be in flight.
+         */
         void invalidate( RegNum num)
         {
             /* Check register number. */
@@ -48,7 +51,16 @@ class RF
             {
                 return;
             }
-            array[ num].is_valid = false;
+            array[ num].writers++;
+        }
+
+        /* Undoes invalidate() by an instruction flushed from the pipeline. */
+        void cancel( RegNum num)
+        {
+            if ( num != REG_NUM_ZERO)
+            {
+                array[ num].writers--;
+            }
         }
 
         inline void read_src1( FuncInstr& instr) const
@@ -71,9 +83,22 @@ class RF
                     cerr << "ERROR: Writing to valid register!\n";
                     exit( EXIT_FAILURE);
                 }
-                /* Write value and make it valid. */
+                /* Write value, it is valid after the last writer. */
                 array[ num].value = instr.get_v_dst();
-                array[ num].is_valid = true;
+                array[ num].writers--;
+            }
+        }
+        /* Returns value of register, e.g. to pass the state to func_sim. */
+        inline uint32 read( RegNum num) const
+        {
+            return array[ num].value;
+        }
+        /* Sets value of valid register, e.g. restored from a checkpoint. */
+        inline void write( RegNum num, uint32 value)
+        {
+            if ( num != REG_NUM_ZERO) // "zero" register is unchangable
+            {
+                array[ num].value = value;
             }
         }
         inline void reset( RegNum num)
@@ -88,7 +113,7 @@ class RF
         }
 
         /* Registers will be zeroed and valid according Reg() constructor. */
-        RF() {}
+        PerfRF() {}
 };
 
 #endif // #ifndef PERF_SIM_RF_H
@@ -0,0 +1,264 @@
+// Generic C
+#include <cstdlib>
+#include <unistd.h>
+
+// Generic C++
+#include <fstream>
+#include <vector>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// MIPT-MIPS modules
+#include <perf_sim.h>
+#include <func_sim.h>
+
+static const char * checkpoint_file = "./perf_sim_test.ckpt";
+static const char * commit_trace_file = "./perf_sim_test.mct";
+
+// the page of code ends at 0x401000, the next one is not mapped
+static const uint32 PAGE_END = 0x401000;
+
+// loop followed by a word which is not an instruction
+static const uint32 loop_before_data[] =
+{
+    0x34090001, // ori  $t1, $zero, 1
+    0x01094021, // loop: addu $t0, $t0, $t1
+    0x081003fd, // j    loop
+    0xfc000000  // data
+};
+
+// loop ending at the last word of the page
+static const uint32 loop_at_page_end[] =
+{
+    0x34090001, // ori  $t1, $zero, 1
+    0x01094021, // loop: addu $t0, $t0, $t1
+    0x081003fe  // j    loop
+};
+
+// copies words from 0x10000000 to the next ones: $t0 = 1, 2, ...
+static const uint32 copy_loop[] =
+{
+    0x3c101000, // lui   $s0, 0x1000
+    0x340903e8, // ori   $t1, $zero, 1000
+    0x8e080000, // loop: lw $t0, 0($s0)
+    0x25080001, // addiu $t0, $t0, 1
+    0xae080004, // sw    $t0, 4($s0)
+    0x26100004, // addiu $s0, $s0, 4
+    0x1509fffb  // bne   $t0, $t1, loop
+};
+
+// dependent instructions, nops follow them as Fetch goes on past the last one
+static const uint32 alu_after_alu[] =
+{
+    0x34080005, // ori   $t0, $zero, 5
+    0x01084821, // addu  $t1, $t0, $t0
+    0, 0, 0, 0
+};
+
+static const uint32 alu_two_after_alu[] =
+{
+    0x34080005, // ori   $t0, $zero, 5
+    0x340a0001, // ori   $t2, $zero, 1
+    0x01084821, // addu  $t1, $t0, $t0
+    0, 0, 0, 0
+};
+
+// $s0 is written long before the load, so only the load result is waited for
+static const uint32 alu_after_load[] =
+{
+    0x3c101000, // lui   $s0, 0x1000
+    0x340a0001, // ori   $t2, $zero, 1
+    0x340b0002, // ori   $t3, $zero, 2
+    0x8e080000, // lw    $t0, 0($s0)
+    0x01084821, // addu  $t1, $t0, $t0
+    0, 0, 0, 0
+};
+
+static const uint32 ori_before_data[] = { 0x34090001, 0xfc000000 };
+static const uint32 ori_at_page_end[] = { 0x34090001, 0x34090001 };
+
+// saves the code placed at the end of the page and the data word at 0x10000000 as a checkpoint
+static void save_program( const uint32* code, size_t size, uint32 data = 0)
+{
+    FuncMemory mem( PAGE_END - 0x1000, 32, 10, 12);
+    uint32 PC = PAGE_END - size * sizeof( uint32);
+    for ( size_t i = 0; i < size; ++i)
+        mem.write( code[ i], PC + i * sizeof( uint32));
+    mem.write( data, 0x10000000);
+
+    Checkpoint::State state = Checkpoint::State();
+    state.PC = PC;
+    Checkpoint::save( checkpoint_file, mem, state);
+}
+
+// runs the saved program and exits if it is done
+static void run_program( int instrs_to_run, BPU::Predictor predictor)
+{
+    PerfMIPS mips;
+    if ( predictor != BPU::PREDICTORS_NUM)
+        mips.enable_branch_prediction( predictor);
+    mips.run( checkpoint_file, instrs_to_run, true);
+    exit( EXIT_SUCCESS);
+}
+
+// no BPU is marked by PREDICTORS_NUM
+static void test_wrong_path( const uint32* code, size_t size)
+{
+    save_program( code, size);
+    for ( int predictor = 0; predictor <= BPU::PREDICTORS_NUM; ++predictor)
+        ASSERT_EXIT( run_program( 30, BPU::Predictor( predictor)),
+                     ::testing::ExitedWithCode( EXIT_SUCCESS), "");
+    unlink( checkpoint_file);
+}
+
+TEST( Perf_sim, Wrong_Path_To_Data)
+{
+    test_wrong_path( loop_before_data, sizeof( loop_before_data) / sizeof( loop_before_data[ 0]));
+}
+
+TEST( Perf_sim, Wrong_Path_To_Unmapped_Page)
+{
+    test_wrong_path( loop_at_page_end, sizeof( loop_at_page_end) / sizeof( loop_at_page_end[ 0]));
+}
+
+TEST( Perf_sim, Executed_Data)
+{
+    save_program( ori_before_data, sizeof( ori_before_data) / sizeof( ori_before_data[ 0]));
+    ASSERT_EXIT( run_program( 30, BPU::PREDICTOR_GSHARE),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.Incorrect instruction.*");
+
+    save_program( ori_at_page_end, sizeof( ori_at_page_end) / sizeof( ori_at_page_end[ 0]));
+    ASSERT_EXIT( run_program( 30, BPU::PREDICTOR_GSHARE),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*unmapped.*");
+    unlink( checkpoint_file);
+}
+
+// runs the saved program by perf_sim and writes the commit trace of simulated instructions
+static void run_fast_forwarded( int instrs_to_skip, int instrs_to_run)
+{
+    std::ofstream file( commit_trace_file, std::ios::binary);
+    CommitTraceWriter commit_trace( file);
+    PerfMIPS mips;
+    mips.run( checkpoint_file, instrs_to_run, true, &commit_trace, instrs_to_skip);
+    file.close();
+    exit( EXIT_SUCCESS);
+}
+
+// reads the commit trace written by a simulator
+static std::vector<CommitRecord> read_commit_trace()
+{
+    std::vector<CommitRecord> records;
+    CommitTraceReader reader( commit_trace_file);
+    CommitRecord record;
+    while ( reader.read( record))
+        records.push_back( record);
+    return records;
+}
+
+TEST( Perf_sim, Fast_Forward)
+{
+    save_program( copy_loop, sizeof( copy_loop) / sizeof( copy_loop[ 0]));
+
+    // the pipeline starts between a load and the instruction using it
+    const int instrs_to_skip = 2 + 5 * 100 + 1;
+    const int instrs_to_run = 5 * 50;
+    {
+        std::ofstream file( commit_trace_file, std::ios::binary);
+        CommitTraceWriter commit_trace( file);
+        Trace trace( Trace::OUTPUT_NONE);
+        MIPS mips;
+        mips.run( checkpoint_file, instrs_to_skip + instrs_to_run, trace,
+                  MIPS::ENGINE_INTERP, &commit_trace);
+    }
+    std::vector<CommitRecord> expected = read_commit_trace();
+    ASSERT_EQ( expected.size(), size_t( instrs_to_skip + instrs_to_run));
+    expected.erase( expected.begin(), expected.begin() + instrs_to_skip);
+
+    ASSERT_EXIT( run_fast_forwarded( instrs_to_skip, instrs_to_run),
+                 ::testing::ExitedWithCode( EXIT_SUCCESS), "");
+    std::vector<CommitRecord> records = read_commit_trace();
+    ASSERT_EQ( records.size(), expected.size());
+    for ( size_t i = 0; i < records.size(); ++i)
+        ASSERT_TRUE( records[ i] == expected[ i]) << "instruction " << i << " at 0x"
+                                                 << std::hex << records[ i].PC;
+
+    unlink( commit_trace_file);
+    unlink( checkpoint_file);
+}
+
+// runs the saved program printing statistics and writes its commit trace
+static void run_with_stats( int instrs_to_run, bool is_bypass)
+{
+    std::ofstream file( commit_trace_file, std::ios::binary);
+    CommitTraceWriter commit_trace( file);
+    PerfMIPS mips;
+    mips.enable_stats();
+    if ( is_bypass)
+        mips.enable_bypass();
+    mips.run( checkpoint_file, instrs_to_run, true, &commit_trace);
+    file.close();
+    exit( EXIT_SUCCESS);
+}
+
+// stats are matched with the output of run_with_stats, $t1 is written last
+static void test_dependency( const uint32* code, size_t size, int instrs_to_run,
+                             bool is_bypass, const char* stats, uint32 result)
+{
+    save_program( code, size, 7);
+    ASSERT_EXIT( run_with_stats( instrs_to_run, is_bypass),
+                 ::testing::ExitedWithCode( EXIT_SUCCESS), stats);
+    std::vector<CommitRecord> records = read_commit_trace();
+    ASSERT_EQ( records.size(), size_t( instrs_to_run));
+    ASSERT_EQ( records.back().dst, REG_NUM_T1);
+    ASSERT_EQ( records.back().value, result);
+    unlink( commit_trace_file);
+    unlink( checkpoint_file);
+}
+
+// Decode waits until the source is written back,
+// each test runs one simulation as the death test child repeats the test
+TEST( Perf_sim, Interlock_After_Alu)
+{
+    test_dependency( alu_after_alu, sizeof( alu_after_alu) / sizeof( alu_after_alu[ 0]), 2,
+                     false, "cycles: 9, instructions: 2,.*waiting for sources: 3 ", 10);
+}
+
+TEST( Perf_sim, Bypass_From_Execute)
+{
+    test_dependency( alu_after_alu, sizeof( alu_after_alu) / sizeof( alu_after_alu[ 0]), 2,
+                     true, "cycles: 6, instructions: 2,.*waiting for sources: 0 ", 10);
+}
+
+TEST( Perf_sim, Interlock_Two_After_Alu)
+{
+    test_dependency( alu_two_after_alu, sizeof( alu_two_after_alu) / sizeof( alu_two_after_alu[ 0]), 3,
+                     false, "cycles: 9, instructions: 3,.*waiting for sources: 2 ", 10);
+}
+
+// as many cycles as three independent instructions take
+TEST( Perf_sim, Bypass_From_Memory)
+{
+    test_dependency( alu_two_after_alu, sizeof( alu_two_after_alu) / sizeof( alu_two_after_alu[ 0]), 3,
+                     true, "cycles: 7, instructions: 3,.*waiting for sources: 0 ", 10);
+}
+
+TEST( Perf_sim, Interlock_Load_Use)
+{
+    test_dependency( alu_after_load, sizeof( alu_after_load) / sizeof( alu_after_load[ 0]), 5,
+                     false, "cycles: 13, instructions: 5,.*waiting for sources: 4 ", 14);
+}
+
+// the loaded value is forwarded from Memory after one stall
+TEST( Perf_sim, Bypass_Load_Use)
+{
+    test_dependency( alu_after_load, sizeof( alu_after_load) / sizeof( alu_after_load[ 0]), 5,
+                     true, "cycles: 10, instructions: 5,.*waiting for sources: 1 ", 14);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}